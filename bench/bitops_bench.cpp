@@ -0,0 +1,73 @@
+// times the bit kernels against the byte at a time versions on frame sized buffers, build with
+// `make bench` (add BENCH_ARCH=-mavx2 for the avx2 kernels on x86)
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "project/bitops.h"
+
+using namespace epaper;
+
+namespace {
+
+constexpr size_t kFrameSize  = 4000;  // 250x122 2.13" frame
+constexpr int    kIterations = 20000;
+
+// nanoseconds per call
+double time_ns(const std::function<void()>& run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++) {
+        run();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / kIterations;
+}
+
+}  // namespace
+
+int main(void) {
+    std::vector<uint8_t> dst(kFrameSize), src(kFrameSize);
+    for (size_t i = 0; i < kFrameSize; i++) {
+        dst[i] = i & 0xFF;
+        src[i] = (i * 7) & 0xFF;
+    }
+
+    volatile bool sink = false;  // keeps the compares from being dropped
+
+    struct Case {
+        const char*           name;
+        std::function<void()> scalar;
+        std::function<void()> kernel;
+    };
+
+    const Case cases[] = {
+        {"invert", [&] { bits::scalar::Invert(dst.data(), kFrameSize); },
+         [&] { bits::Invert(dst.data(), kFrameSize); }},
+        {"fill", [&] { bits::scalar::Fill(dst.data(), kFrameSize, 0xFF); },
+         [&] { bits::Fill(dst.data(), kFrameSize, 0xFF); }},
+        {"copy", [&] { bits::scalar::Copy(dst.data(), src.data(), kFrameSize); },
+         [&] { bits::Copy(dst.data(), src.data(), kFrameSize); }},
+        {"and", [&] { bits::scalar::And(dst.data(), src.data(), kFrameSize); },
+         [&] { bits::And(dst.data(), src.data(), kFrameSize); }},
+        {"or", [&] { bits::scalar::Or(dst.data(), src.data(), kFrameSize); },
+         [&] { bits::Or(dst.data(), src.data(), kFrameSize); }},
+        {"xor", [&] { bits::scalar::Xor(dst.data(), src.data(), kFrameSize); },
+         [&] { bits::Xor(dst.data(), src.data(), kFrameSize); }},
+        {"equal", [&] { sink = bits::scalar::Equal(dst.data(), dst.data(), kFrameSize); },
+         [&] { sink = bits::Equal(dst.data(), dst.data(), kFrameSize); }},
+    };
+
+    std::printf("kernels: %s, %zu byte buffers\n", bits::Isa(), kFrameSize);
+    std::printf("%-8s %12s %12s %8s\n", "", "scalar ns", "kernel ns", "speedup");
+
+    for (const auto& c : cases) {
+        double scalar = time_ns(c.scalar);
+        double kernel = time_ns(c.kernel);
+        std::printf("%-8s %12.1f %12.1f %7.1fx\n", c.name, scalar, kernel, scalar / kernel);
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace epaper {
+
+// bump allocator for the buffers of one frame, everything is handed back at once by Reset so a
+// frame's bitmaps don't go through malloc and free
+class FrameArena {
+   public:
+    explicit FrameArena(size_t capacity);
+
+    // size bytes starting on a multiple of alignment (a power of two), nullptr once the arena is
+    // full so the caller has to fall back to the heap
+    uint8_t* Allocate(size_t size, size_t alignment);
+
+    // start over for the next frame, nothing allocated since the last reset may be used after
+    // this, grows to the largest frame so far if it didn't fit
+    void Reset(void);
+
+    size_t capacity() const { return this->capacity_; }  // get arena size in bytes
+    size_t used() const { return this->used_; }          // get bytes handed out this frame
+
+   private:
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t                     capacity_;
+    size_t                     used_   = 0;
+    size_t                     wanted_ = 0;  // used_ plus everything that didn't fit
+};
+
+}  // namespace epaper
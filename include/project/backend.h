@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace epaper {
+
+// bcm gpio numbers of the display control lines
+struct PanelPins {
+    uint8_t rst  = 17;
+    uint8_t dc   = 25;
+    uint8_t cs   = 8;
+    uint8_t busy = 24;
+};
+
+// how a display is wired up
+struct PanelConfig {
+    PanelPins pins;
+    uint8_t   spi_channel = 0;
+    uint32_t  spi_speed   = 10000000;  // hz, the controller takes up to 20mhz for writes
+
+    // held while the display is selected, shared by displays on the same spi bus
+    std::shared_ptr<std::mutex> bus_lock;
+};
+
+// gpio access used by the display driver, pin numbers are bcm gpio numbers
+class GpioBackend {
+   public:
+    enum Mode { kModeInput = 0, kModeOutput = 1 };
+
+    virtual ~GpioBackend() {}
+
+    virtual bool    Setup(void)                           = 0;  // init gpio access
+    virtual void    SetMode(uint8_t pin, Mode mode)       = 0;  // set mode, inputs are pulled up
+    virtual void    Write(uint8_t pin, uint8_t value)     = 0;  // drive output pin low (0) or high
+    virtual uint8_t Read(uint8_t pin)                     = 0;  // read input pin level
+    virtual bool    WaitForLow(uint8_t pin, int64_t msec) = 0;  // false if pin is still high
+};
+
+// spi bus, chip select is driven through gpio by the display driver
+class SpiBackend {
+   public:
+    virtual ~SpiBackend() {}
+
+    virtual bool Setup(uint8_t channel, uint32_t speed) = 0;  // open channel at speed in hz
+    virtual void Write(const uint8_t* data, size_t len) = 0;  // transfer len bytes
+
+    // receive len bytes, false if the bus is wired write only
+    virtual bool Read(uint8_t* data, size_t len) {
+        (void)data;
+        (void)len;
+        return false;
+    }
+};
+
+// default backends on the raspberry pi through the wiringpi library
+class WiringPiGpio : public GpioBackend {
+   public:
+    bool    Setup(void) override;
+    void    SetMode(uint8_t pin, Mode mode) override;
+    void    Write(uint8_t pin, uint8_t value) override;
+    uint8_t Read(uint8_t pin) override;
+    bool    WaitForLow(uint8_t pin, int64_t msec) override;  // waits for the falling edge
+
+   private:
+    static constexpr int64_t kPollMsec = 50;  // poll period for pins without an interrupt
+
+    // falling edges are counted from the wiringpi interrupt thread, the callback takes no
+    // arguments so the state is shared between instances
+    static std::mutex              edge_mutex_;
+    static std::condition_variable edge_cv_;
+    static uint32_t                edges_;
+
+    std::set<uint8_t> interrupt_pins_;  // inputs with a falling edge interrupt set up
+
+    static void edge_isr_(void);  // interrupt callback for falling edges on input pins
+};
+
+class WiringPiSpi : public SpiBackend {
+   public:
+    bool Setup(uint8_t channel, uint32_t speed) override;
+    void Write(const uint8_t* data, size_t len) override;
+
+   private:
+    // spidev's default bufsiz, larger transfers have to be split into chunks
+    static constexpr size_t kChunkSize = 4096;
+
+    uint8_t channel_ = 0;
+
+    // wiringPiSPIDataRW overwrites its buffer with the received bytes so data is staged here
+    uint8_t buffer_[kChunkSize];
+};
+
+// gpio through the registers mapped from /dev/gpiomem, a write is a single store instead of a
+// library call, bcm2835 to bcm2711 pis (not the pi 5)
+class GpiomemGpio : public GpioBackend {
+   public:
+    ~GpiomemGpio();
+
+    bool    Setup(void) override;  // map the registers, true if they are already mapped
+    void    SetMode(uint8_t pin, Mode mode) override;
+    void    Write(uint8_t pin, uint8_t value) override;
+    uint8_t Read(uint8_t pin) override;
+    bool    WaitForLow(uint8_t pin, int64_t msec) override;  // waits for the falling edge
+
+   private:
+    static constexpr size_t  kMapSize  = 0xF4;  // up to the bcm2711 pull registers
+    static constexpr int64_t kPollMsec = 5;     // poll period for pins without edge events
+
+    volatile uint32_t* registers_ = nullptr;
+    bool               bcm2711_   = false;  // pull resistors are set through other registers
+
+    // falling edge events of input pins from the gpio character device, the registers have no
+    // way to wait for a pin
+    std::map<uint8_t, int> edge_fds_;
+
+    void set_pull_up_(uint8_t pin);
+    void request_edges_(uint8_t pin);  // polling is left as the fallback if this fails
+};
+
+// talks to /dev/spidev0.<channel> directly, data is sent straight from the caller's buffer with
+// as many transfers as fit into one ioctl
+class SpidevSpi : public SpiBackend {
+   public:
+    ~SpidevSpi();
+
+    bool Setup(uint8_t channel, uint32_t speed) override;
+    void Write(const uint8_t* data, size_t len) override;
+
+   private:
+    // spidev limits the bytes of one message to its bufsiz module parameter, each transfer of
+    // a message stays within its default
+    static constexpr size_t kSegmentSize = 4096;
+    static constexpr size_t kMaxSegments = 16;
+
+    int      fd_     = -1;
+    uint32_t speed_  = 0;
+    size_t   bufsiz_ = kSegmentSize;
+};
+
+}  // namespace epaper
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace epaper {
+
+// bulk operations on packed 1 bit pixels, vectorized with neon, avx2 or sse2 when the build
+// targets them and a word at a time otherwise
+namespace bits {
+
+void Invert(uint8_t* data, size_t len);                   // flip every bit
+void Fill(uint8_t* data, size_t len, uint8_t value);       // set every byte to value
+void Copy(uint8_t* dst, const uint8_t* src, size_t len);  // dst = src, they may not overlap
+void And(uint8_t* dst, const uint8_t* src, size_t len);   // dst &= src
+void Or(uint8_t* dst, const uint8_t* src, size_t len);    // dst |= src
+void Xor(uint8_t* dst, const uint8_t* src, size_t len);   // dst ^= src
+
+bool Equal(const uint8_t* a, const uint8_t* b, size_t len);  // true if all len bytes match
+
+// 8x8 pixel block, one row per byte with row 0 in the top byte and pixels msb first, mirrored
+// along its diagonal so row y becomes column y
+uint64_t Transpose8x8(uint64_t block);
+
+uint8_t Reverse(uint8_t byte);  // pixels of a byte in the opposite order
+
+const char* Isa(void);  // instruction set the kernels were built for
+
+// byte at a time versions the kernels are checked and benchmarked against
+namespace scalar {
+
+void Invert(uint8_t* data, size_t len);
+void Fill(uint8_t* data, size_t len, uint8_t value);
+void Copy(uint8_t* dst, const uint8_t* src, size_t len);
+void And(uint8_t* dst, const uint8_t* src, size_t len);
+void Or(uint8_t* dst, const uint8_t* src, size_t len);
+void Xor(uint8_t* dst, const uint8_t* src, size_t len);
+
+bool Equal(const uint8_t* a, const uint8_t* b, size_t len);
+
+}  // namespace scalar
+
+}  // namespace bits
+
+}  // namespace epaper
@@ -1,112 +1,423 @@
 #pragma once
 
 #include <ft2build.h>
-#include <wiringPi.h>
-#include <wiringPiSPI.h>
 #include FT_FREETYPE_H
 
 #include <curl/curl.h>
 #include <math.h>
 
 #include <algorithm>
+#include <array>
 #include <bitset>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <ctime>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <thread>
+#include <vector>
 
+#include "project/arena.h"
+#include "project/backend.h"
+#include "project/bitops.h"
+#include "project/lut.h"
+#include "project/panel.h"
 #include "third-party/json.hpp"
 
 namespace epaper {
 
 using json = nlohmann::json;
 
-class Epaper {
+// types shared by the display drivers of every panel
+class EpaperBase {
    public:
-    const uint8_t kSpiChannel = 0;
+    // rectangle of the display in pixels, the width is widened to whole bytes when sent
+    struct Window {
+        uint16_t height_start;
+        uint16_t width_start;
+        uint16_t height;
+        uint16_t width;
+    };
+
+    // where the time of a display cycle goes, since construction or the last ResetStats
+    struct Stats {
+        uint64_t commands    = 0;  // command bytes
+        uint64_t data_bytes  = 0;  // data bytes
+        uint64_t transfers   = 0;  // spi writes
+        uint64_t gpio_writes = 0;  // gpio writes, chip select and dc toggle around most transfers
+
+        std::array<uint64_t, 256> command_bytes = {};  // data bytes sent for each command
+
+        uint64_t                  busy_waits = 0;
+        uint64_t                  busy_polls = 0;  // pin reads near the predicted end of a wait
+        std::chrono::microseconds busy_time{0};    // blocked in BusyWait, the panel
+        uint64_t                  waits = 0;
+        std::chrono::microseconds wait_time{0};  // in Wait, fixed sleeps
+
+        uint64_t full_refreshes    = 0;
+        uint64_t partial_refreshes = 0;
+    };
+
+    // what the display is busy with, waits are predicted from earlier ones of the same kind
+    enum BusyOperation : uint8_t {
+        BusyInit        = 0,  // resets and init sequences
+        BusyFull        = 1,  // full refresh
+        BusyPartial     = 2,  // partial refresh
+        BusySleep       = 3,  // power off before deep sleep
+        BusyFill        = 4,  // ram filled with a regular pattern
+        BusyTemperature = 5,  // temperature sensor read
+        BusyOther       = 6,
+    };
+};
+
+// display driver for one of the panels in panel.h, instantiated for each of them in epaper.cpp
+template <typename Panel>
+class BasicEpaper : public EpaperBase {
+   public:
+    static constexpr uint16_t kHeight    = Panel::kHeight;
+    static constexpr uint16_t kWidth     = Panel::kWidth;
+    static constexpr uint16_t kFrameSize = kHeight * ((kWidth + 7) / 8);  // image size in bytes
 
-    static constexpr uint8_t kHeight = 250;
-    static constexpr uint8_t kWidth  = 122;
+    // wiringpi gpio and spi, defined with the wiringpi backend
+    explicit BasicEpaper(PanelConfig config = PanelConfig());
+    BasicEpaper(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                PanelConfig config = PanelConfig());
 
     void SetUpIos(void);                // set up pin ios and spi bus
     void Shutdown(void);                // shutdown routine including reseting all configured ios
     void InitFullUpdate(void);          // init device for full update
+    void InitFastUpdate(void);          // init device for full update with the fast waveform
     void Reset(void);                   // hard reset of device
-    void BusyWait(void);                // busywait on busy pin
+    void BusyWait(BusyOperation operation = BusyOther);  // wait for busy pin to go idle
     void ClearDisplay(void);            // clear screen (all pixels white)
-    void DisplayImage(uint8_t* image);  // display image
+    void DisplayImage(uint8_t* image);  // display image, only sends the rows that changed
     void DeepSleep(void);               // enter deep sleep / low power mode
     void Wait(int64_t msec);            // wait for msec
 
+    // leave deep sleep restoring the last init, display calls wake the device when needed
+    void Wake(void);
+
+    // partial updates only redraw the pixels that changed and skip the black/white flash
+    void InitPartialUpdate(void);           // init device for partial update, after a full init
+    void DisplayBaseImage(uint8_t* image);  // display image as the base for partial updates
+    void DisplayPartial(uint8_t* image);    // display image using a partial update
+
+    // waveforms are picked from luts for the update mode and panel temperature, luts has to
+    // outlive the epaper
+    void SetLuts(const LutRegistry& luts);
+    void ForceTemperature(int8_t celsius);  // use celsius instead of reading the sensor
+
+    // read the temperature sensor unless forced and upload its waveform if that changed, init
+    // and wake do this on their own
+    int8_t UpdateTemperature(void);
+
+    const Stats& stats(void) const { return this->stats_; }
+    void         ResetStats(void);
+    void         DumpStats(std::wostream& out) const;  // print the stats, one line per counter
+
+    // dump the stats to wcout after the first refresh once period has passed, 0 turns it off
+    void SetStatsDump(std::chrono::seconds period);
+
+    // only sends the bytes inside window from the full size image, refreshes with the init mode
+    void DisplayWindow(uint8_t* image, Window window);
+
+    // fill window with the value byte, whole display fills are done by the controller itself
+    void FillRegion(Window window, uint8_t value);
+
    private:
-    enum GpioMode { GpioModeInput = 0, GpioModeOutput = 1 };
-    const uint8_t kPinRst  = 17;
-    const uint8_t kPinDc   = 25;
-    const uint8_t kPinCs   = 8;
-    const uint8_t kPinBusy = 24;
-
-    const uint16_t kHeightBound = this->kHeight;
-    const uint16_t kWidthBound =
-        (this->kWidth % 8 == 0) ? (this->kWidth / 8) : (this->kWidth / 8 + 1);
-
-    const uint8_t kLutFullUpdate[76] = {
-        0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
-        0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
-        0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
-        0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
-
-        0x03, 0x03, 0x00, 0x00, 0x02,  // TP0 A~D RP0
-        0x09, 0x09, 0x00, 0x00, 0x02,  // TP1 A~D RP1
-        0x03, 0x03, 0x00, 0x00, 0x02,  // TP2 A~D RP2
-        0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
-        0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
-        0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
-        0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
-
-        0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
+    enum UpdateMode { UpdateModeFull = 0, UpdateModePartial = 1, UpdateModeFast = 2 };
+
+    // ram window bounds in bytes on the x axis and rows on the y axis, ends are inclusive
+    struct RamWindow {
+        uint16_t x_start;
+        uint16_t x_end;
+        uint16_t y_start;
+        uint16_t y_end;
     };
 
-    // const uint8_t kLutPartialUpdate[76] = {
-    //     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
-    //     0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
-    //     0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
-    //     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
-    //     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
-
-    //     0x0A, 0x00, 0x00, 0x00, 0x00,  // TP0 A~D RP0
-    //     0x00, 0x00, 0x00, 0x00, 0x00,  // TP1 A~D RP1
-    //     0x00, 0x00, 0x00, 0x00, 0x00,  // TP2 A~D RP2
-    //     0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
-    //     0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
-    //     0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
-    //     0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
-
-    //     0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
-    // };
-
-    void set_gpio_mode_(int pin, GpioMode mode);  // set pin gpio mode
-    void send_command_(uint8_t reg);              // send command to command register
-    void send_data_(uint8_t data);                // send data
-    void turn_display_on_(void);                  // turn on display
+    PanelConfig                  config_;
+    std::unique_lock<std::mutex> bus_guard_;  // owns the bus lock while selected
+
+    static constexpr uint16_t kHeightBound = kHeight;
+    static constexpr uint16_t kWidthBound  = (kWidth + 7) / 8;
+
+    std::shared_ptr<GpioBackend> gpio_;
+    std::shared_ptr<SpiBackend>  spi_;
+
+    // transfers gathered from several places or repeated bytes are staged in chunks of this size
+    static constexpr size_t kSpiChunkSize = 4096;
+
+    uint8_t spi_buffer_[kSpiChunkSize];
+
+    // approximate bytes it takes to set up a ram window, used to decide when to merge windows
+    static constexpr uint16_t kWindowOverhead = 16;
+
+    // longest the display may stay busy before waiting gives up, a full refresh takes ~3s
+    static constexpr int64_t kBusyTimeoutMsec = 10000;
+
+    // busy durations of each operation in kBusyBucketMsec buckets, the counts are halved once
+    // there are kBusySamplesMax samples so old ones fade out
+    static constexpr int64_t  kBusyBucketMsec   = 10;
+    static constexpr size_t   kBusyBuckets      = 400;
+    static constexpr uint32_t kBusySamplesMax   = 256;
+    static constexpr uint32_t kBusySamplesMin   = 3;   // samples before waits are predicted
+    static constexpr uint32_t kBusyEarlyPercent = 5;   // sleep until this many have finished
+    static constexpr uint32_t kBusyLatePercent  = 95;  // poll until this many have finished
+    static constexpr int64_t  kBusyPollMsec     = 1;
+
+    struct BusyHistogram {
+        std::array<uint16_t, kBusyBuckets> counts = {};
+        uint32_t                           total  = 0;
+    };
+
+    std::array<BusyHistogram, BusyOther + 1> busy_histograms_;  // by BusyOperation
+
+    // time the reset line settles for, the controller signals busy after a reset from deep sleep
+    // so it can be much shorter there
+    static constexpr int64_t kColdResetMsec = 200;
+    static constexpr int64_t kWarmResetMsec = 10;
+
+    UpdateMode update_mode_ = UpdateModeFull;  // waveform loaded by the last init
+    bool       asleep_      = false;           // in deep sleep, registers lost on wake
+
+    // controller can fill its ram with a regular pattern (0x46/0x47)
+    const bool kHardwareFill = true;
+
+    // windows of the new ram (0x24) that have to be copied to the old ram (0x26) after the next
+    // refresh, or a fill of all of it
+    std::vector<RamWindow> old_ram_pending_;
+    bool                   old_ram_fill_pending_ = false;
+    uint8_t                old_ram_fill_value_   = 0xFF;
+
+    // copy of the display ram, ram content is unknown until a full frame has been sent
+    std::array<uint8_t, kFrameSize> shadow_;
+    bool                            shadow_valid_ = false;
+
+    // waveforms to pick from and the one in the controller, the controller loses it on reset
+    const LutRegistry* luts_       = &LutRegistry::Default();
+    const uint8_t*     loaded_lut_ = nullptr;
+
+    // panel temperature the waveform is picked for, assumed to be room temperature when the
+    // sensor can't be read back (the data line on the waveshare hat is write only)
+    static constexpr int8_t kDefaultCelsius = 20;
+
+    int8_t temperature_        = kDefaultCelsius;
+    bool   temperature_forced_ = false;
+    bool   sensor_readable_    = true;  // cleared after the first failed read
+
+    Stats                                 stats_;
+    std::chrono::seconds                  dump_period_{0};
+    std::chrono::steady_clock::time_point last_dump_;
+
+    static constexpr uint8_t kPinUnknown = 0xFF;
+
+    uint8_t dc_           = kPinUnknown;  // level dc was last driven to
+    uint8_t last_command_ = 0x00;         // data bytes are counted for it
+
+    void reset_(int64_t settle_msec);  // hard reset with settle_msec around the pulse
+
+    // every pin write and transfer goes through these so they are counted
+    void gpio_write_(uint8_t pin, uint8_t value);
+    void spi_write_(const uint8_t* data, size_t len);
+    void count_refresh_(bool partial);  // count a refresh and dump the stats when due
+
+    void    record_busy_(BusyOperation operation, int64_t msec);  // add a wait to the histogram
+    int64_t predict_busy_(BusyOperation operation, uint32_t percent) const;  // -1 if unknown
+
+    void select_(void);    // pull chip select low, waiting for the bus if it's shared
+    void deselect_(void);  // release chip select and the bus
+
+    // send the commands of an init sequence with lut as the source for CommandFromLut payloads,
+    // its busy waits are predicted as operation
+    void run_sequence_(const Command* sequence, size_t length, const uint8_t* lut,
+                       BusyOperation operation = BusyInit);
+
+    void send_command_(uint8_t reg);                     // send command to command register
+    void send_data_(uint8_t data);                       // send data
+    void send_data_(const uint8_t* data, size_t len);    // send data buffer in one transaction
+    void send_repeated_data_(uint8_t data, size_t len);  // send the same data byte len times
+    void turn_display_on_(void);                         // turn on display
+    void turn_display_on_partial_(void);                 // turn on display for partial update
+    void sync_old_ram_(void);                            // copy refreshed windows to old ram
+    bool read_data_(uint8_t* data, size_t len);          // read data, false if not supported
+
+    void    init_full_(UpdateMode mode);  // reset and init for a full update with mode's waveform
+    void    init_registers_(void);        // panel and full update registers after a reset
+    LutKind lut_kind_(void) const;        // waveform kind of the current update mode
+    bool    read_temperature_(void);      // read the temperature sensor, false if not supported
+    void    load_lut_(void);              // upload the waveform for the temperature if not loaded
+
+    RamWindow to_ram_window_(Window window) const;  // clip and convert window to ram bounds
+    void      set_ram_window_(RamWindow window);    // set ram area and move counters to its start
+    void      send_window_(const uint8_t* image, RamWindow window);   // send window of image
+    void      write_window_(const uint8_t* image, RamWindow window);  // write ram and shadow
+    void      fill_window_(RamWindow window, uint8_t value);          // fill ram and shadow
+    void      refresh_(void);  // turn on display with the waveform of the current update mode
+};
+
+extern template class BasicEpaper<Panel213>;
+extern template class BasicEpaper<Panel290>;
+extern template class BasicEpaper<Panel420>;
+
+using Epaper = BasicEpaper<Panel213>;
+
+// decides between a quick partial update and a slow full refresh, partial updates leave some
+// ghosting behind wherever pixels flip so a full refresh clears it once too much has built up
+// or at a quiet hour when nobody is looking at the flash
+template <typename Panel>
+class BasicRefreshPolicy {
+   public:
+    using Epaper = BasicEpaper<Panel>;
+
+    struct Budget {
+        uint32_t partials        = 30;  // partial updates between full refreshes
+        uint32_t flips_per_pixel = 4;   // average flips in any region between full refreshes
+        int      quiet_hour      = 3;   // local hour for a daily full refresh, -1 for none
+    };
+
+    explicit BasicRefreshPolicy(Epaper& paper);
+    BasicRefreshPolicy(Epaper& paper, Budget budget);
+
+    // show image with a partial update, or a full refresh when the budget ran out or it's the
+    // quiet hour, nothing is sent when image is already shown
+    void Display(uint8_t* image,
+                 std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+    void ForceFull(void) { this->base_valid_ = false; }  // make the next display a full refresh
+
+    uint32_t partials(void) const { return this->partials_; }  // since the last full refresh
+    uint32_t MaxRegionFlips(void) const;  // most flips in a region since the last full refresh
+
+   private:
+    // regions are 16x16 pixel blocks, ghosting builds up locally where the content changes
+    static constexpr uint16_t kRegionRows   = 16;
+    static constexpr uint16_t kRegionBytes  = 2;
+    static constexpr uint16_t kRegionPixels = kRegionRows * kRegionBytes * 8;
+    static constexpr uint16_t kWidthBound   = (Epaper::kWidth + 7) / 8;
+    static constexpr uint16_t kRegionsHigh  = (Epaper::kHeight + kRegionRows - 1) / kRegionRows;
+    static constexpr uint16_t kRegionsWide  = (kWidthBound + kRegionBytes - 1) / kRegionBytes;
+
+    Epaper& paper_;
+    Budget  budget_;
+
+    std::array<uint8_t, Epaper::kFrameSize> base_;  // image on the display
+    bool                                    base_valid_ = false;
+
+    uint32_t                                          partials_ = 0;
+    std::array<uint32_t, kRegionsHigh * kRegionsWide> flips_;  // per region, row major
+    std::chrono::system_clock::time_point             last_full_;
+
+    bool quiet_hour_due_(std::chrono::system_clock::time_point now) const;  // no full this hour
+    void display_full_(uint8_t* image, std::chrono::system_clock::time_point now);
+};
+
+// runs display operations in order on a dedicated thread so the caller can fetch and render the
+// next frame while the panel is refreshing, the epaper must not be used directly in the meantime
+template <typename Panel>
+class BasicAsyncDisplay {
+   public:
+    using Epaper = BasicEpaper<Panel>;
+
+    explicit BasicAsyncDisplay(Epaper& paper);
+    ~BasicAsyncDisplay();  // finishes the queued operations before returning
+
+    BasicAsyncDisplay(const BasicAsyncDisplay&) = delete;
+    BasicAsyncDisplay& operator=(const BasicAsyncDisplay&) = delete;
+
+    std::future<void> DisplayImage(const uint8_t* image);  // queue a copy of image for display
+    std::future<void> ClearDisplay(void);                  // queue a clear of the display
+
+    // queue any other operation, the future holds the exception if the operation threw
+    std::future<void> Run(std::function<void(Epaper&)> operation);
+
+   private:
+    Epaper& paper_;
+
+    std::mutex                             mutex_;
+    std::condition_variable                cv_;
+    std::deque<std::packaged_task<void()>> queue_;
+    bool                                   stopping_ = false;
+
+    std::thread worker_;  // started last so the queue is ready when it runs
+
+    void worker_loop_(void);  // runs queued operations until stopped and the queue is empty
 };
 
+// displays sharing one spi bus, each with its own control pins and worker thread so one panel's
+// refresh overlaps with the transfers and refreshes of the others
+template <typename Panel>
+class BasicPanelGroup {
+   public:
+    using Epaper = BasicEpaper<Panel>;
+
+    BasicPanelGroup() : bus_lock_(std::make_shared<std::mutex>()) {}
+
+    // add a display, the group's bus lock replaces the one in config
+    Epaper& Add(PanelConfig config);  // wiringpi gpio and spi, defined with the wiringpi backend
+    Epaper& Add(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                PanelConfig config);
+
+    size_t  size() const { return this->panels_.size(); }
+    Epaper& operator[](size_t idx) { return *this->panels_[idx]; }
+
+    // run operation on every display at once and wait for all of them, rethrows the first error
+    void Run(std::function<void(Epaper&, size_t)> operation);
+
+    void SetUpIos(void);
+    void InitFullUpdate(void);
+    void ClearDisplay(void);
+    void DisplayImages(const std::vector<uint8_t*>& images);  // one image per display
+
+   private:
+    std::shared_ptr<std::mutex> bus_lock_;
+
+    std::vector<std::unique_ptr<Epaper>>       panels_;
+    std::vector<std::unique_ptr<BasicAsyncDisplay<Panel>>> workers_;  // destroyed first
+};
+
+extern template class BasicRefreshPolicy<Panel213>;
+extern template class BasicRefreshPolicy<Panel290>;
+extern template class BasicRefreshPolicy<Panel420>;
+extern template class BasicAsyncDisplay<Panel213>;
+extern template class BasicAsyncDisplay<Panel290>;
+extern template class BasicAsyncDisplay<Panel420>;
+extern template class BasicPanelGroup<Panel213>;
+extern template class BasicPanelGroup<Panel290>;
+extern template class BasicPanelGroup<Panel420>;
+
+using RefreshPolicy = BasicRefreshPolicy<Panel213>;
+using AsyncDisplay  = BasicAsyncDisplay<Panel213>;
+using PanelGroup    = BasicPanelGroup<Panel213>;
+
 // for monochrome images
 class Bitmap {
    public:
+    enum Rotation {
+        kRotation0 = 0,
+        kRotation90,  // clockwise
+        kRotation180,
+        kRotation270,
+    };
+
     uint16_t height() const { return this->height_; }              // get height in pixels
     uint16_t width() const { return this->width_; }                // get width in pixels
     uint16_t height_bound() const { return this->height_bound_; }  // get height in padded bytes
     uint16_t width_bound() const { return this->width_bound_; }    // get width in bytes
+    size_t   size() const { return this->size_; }                  // get buffer size in bytes
 
     // height and width in pixel values - initialized to white only image
     Bitmap(uint16_t height, uint16_t width);
+    Bitmap(uint16_t height, uint16_t width, FrameArena& arena);  // valid until the arena resets
     Bitmap(Bitmap&& move) noexcept;
 
     Bitmap& operator=(Bitmap&& move) noexcept;
@@ -115,7 +426,16 @@ class Bitmap {
     void ClearBlack();  // clears the image to black
     void Invert();      // inverts the pixel values 1 -> 0 / 0 -> 1
 
-    uint8_t* Raw();  // returns raw buffer
+    uint8_t*       Raw();        // returns raw buffer, rows are width_bound bytes apart
+    const uint8_t* Raw() const;  // returns raw buffer, rows are width_bound bytes apart
+
+    // copy turned clockwise by rotation, 90 and 270 swap height and width
+    Bitmap Rotated(Rotation rotation) const;
+    Bitmap Rotated(Rotation rotation, FrameArena& arena) const;  // valid until the arena resets
+
+    // copy mirrored along the diagonal, row y becomes column y
+    Bitmap Transposed() const;
+    Bitmap Transposed(FrameArena& arena) const;  // valid until the arena resets
 
     void Print() const;  // print image to terminal
 
@@ -139,9 +459,28 @@ class Bitmap {
     uint16_t height_bound_;
     uint16_t width_bound_;
 
-    // buffer of actual image data
-    std::unique_ptr<uint8_t*[]> buffer_;      // 2d array [row][col]
-    std::unique_ptr<uint8_t[]>  buffer_raw_;  // 1d array with all of the continguous
+    // the buffer starts on a cache line, glyphs and icons are small enough to be kept inline
+    static constexpr size_t kAlignment  = 64;
+    static constexpr size_t kInlineSize = 256;
+
+    size_t size_;
+
+    // buffer of actual image data, rows are packed so the frame can be sent as is
+    uint8_t*                   buffer_;  // inside inline_, heap_ or an arena
+    std::unique_ptr<uint8_t[]> heap_;    // padded for the alignment
+    uint8_t                    inline_[kInlineSize + kAlignment - 1];  // padded for the alignment
+
+    void allocate_(FrameArena* arena);  // set up buffer_, from the arena if it has room
+    void take_buffer_(Bitmap& move);    // steal move's buffer, inline data has to be copied
+
+    Bitmap rotated_(Rotation rotation, FrameArena* arena) const;
+
+    // transpose into dst in 8x8 blocks, optionally reading this bottom up or writing dst bottom
+    // up which turns the transpose into a 90 or 270 degree rotation
+    void transpose_into_(Bitmap& dst, bool reverse_rows, bool reverse_dst_rows) const;
+    void rotate_180_into_(Bitmap& dst) const;
+
+    static uint8_t* align_(uint8_t* storage);  // first cache line boundary in storage
 };
 
 class Renderer {
@@ -150,11 +489,13 @@ class Renderer {
         kRenderActionReplace = 0,
         kRenderActionAnd,
         kRenderActionOr,
+        kRenderActionXor,
     };
 
     virtual ~Renderer() {}
 
-    // draw on image using the selection action from the given starting location
+    // draw on image using the selection action from the given starting location, start_width
+    // can be any pixel and src is clipped to the target
     void DrawOnImage(Bitmap& target, Bitmap& src, uint16_t start_height, uint16_t start_width,
                      RenderAction action = kRenderActionAnd);
 };
@@ -173,7 +514,8 @@ class TextRenderer : public Renderer {
     TextRenderer(uint16_t size, std::string font);
     virtual ~TextRenderer();
 
-    Bitmap RenderText(std::wstring text);
+    Bitmap RenderText(const std::wstring& text);
+    Bitmap RenderText(const std::wstring& text, FrameArena& arena);  // valid until arena resets
 
    private:
     uint16_t    size_;
@@ -183,7 +525,12 @@ class TextRenderer : public Renderer {
     FT_Face      face_;
     FT_GlyphSlot slot_;
 
-    void print_FT_Bitmap(FT_Bitmap* bitmap) const;
+    // the upright layout only lives until it is turned, this grows to the largest one so far and
+    // is reused so steady state rendering doesn't touch the heap
+    FrameArena scratch_;
+
+    void   print_FT_Bitmap(FT_Bitmap* bitmap) const;
+    Bitmap render_text_(const std::wstring& text, FrameArena* arena);
 };
 
 class Weather {
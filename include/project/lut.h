@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace epaper {
+
+// waveform (0x32) followed by the gate voltage (0x03), source voltages (0x04), dummy line (0x3A)
+// and gate time (0x3B) it was tuned with
+constexpr size_t kLutSize = 76;
+
+enum LutKind : uint8_t {
+    LutKindFull    = 0,  // full update, flashes the whole display
+    LutKindPartial = 1,  // partial update, only drives the pixels that changed
+    LutKindFast    = 2,  // full update with shorter phases, more ghosting left behind
+};
+
+// waveform for one kind of update over a range of panel temperatures
+struct Lut {
+    LutKind        kind;
+    int8_t         min_celsius;  // inclusive
+    int8_t         max_celsius;  // inclusive
+    const uint8_t* data;         // kLutSize bytes, must outlive the registry
+};
+
+// the particles move slower in the cold so waveforms are only good for a range of temperatures,
+// displays look up the one for their current update kind and temperature here
+class LutRegistry {
+   public:
+    static const LutRegistry& Default();  // vendor waveforms for the 2.13" v2 panel
+
+    // Default plus hand tuned fast and below 10 degree waveforms, they haven't been checked
+    // against the panel and can ghost or wear pixels so they are only used when passed to SetLuts
+    static const LutRegistry& Experimental();
+
+    void Add(Lut lut);  // entries added later take precedence over overlapping ones
+
+    // nullptr if no waveform of kind covers celsius
+    const Lut* Find(LutKind kind, int8_t celsius) const;
+
+   private:
+    std::vector<Lut> luts_;
+};
+
+}  // namespace epaper
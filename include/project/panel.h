@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+
+namespace epaper {
+
+enum CommandFlags : uint8_t {
+    CommandBusyBefore = 0x01,  // wait for the display to be idle before sending
+    CommandBusyAfter  = 0x02,  // wait for the display to be idle after sending
+    CommandFromLut    = 0x04,  // payload is read from the lut starting at data[0]
+};
+
+// one step of an init sequence, the payload is sent in a single transfer
+struct Command {
+    uint8_t reg;      // command register
+    uint8_t flags;    // CommandFlags
+    uint8_t length;   // payload length in bytes
+    uint8_t data[7];  // payload, unused past length
+};
+
+// panels the display driver is built for, everything it needs to know about a panel is fixed at
+// compile time so frame buffers and tables are sized for it:
+//   kHeight, kWidth   gates and sources, rows and columns of the image
+//   kInit             panel specific registers sent after the soft reset, the gate count, data
+//                     entry mode and ram window are set up by the driver from the dimensions
+//   kInitPartial      registers for partial updates, sent on top of the full update ones
+//   kUploadLuts       waveforms come from the LutRegistry, the controller's otp ones otherwise
+//   kFullUpdate       display update control 2 for a full refresh
+//   kPartialUpdate    display update control 2 for a partial refresh
+
+// waveshare 2.13" v2, 250x122
+struct Panel213 {
+    static constexpr uint16_t kHeight = 250;
+    static constexpr uint16_t kWidth  = 122;
+
+    static constexpr Command kInit[] = {
+        {0x74, 0, 1, {0x54}},  // set analog block control
+        {0x7E, 0, 1, {0x3B}},  // set digital block control
+        {0x3C, 0, 1, {0x03}},  // BorderWavefrom
+        {0x2C, 0, 1, {0x55}},  // VCOM Voltage
+    };
+
+    static constexpr Command kInitPartial[] = {
+        {0x2C, CommandBusyAfter, 1, {0x26}},  // VCOM Voltage
+
+        // display option, ram ping-pong off since the old ram is kept up to date by the driver
+        {0x37, 0, 7, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+
+        {0x22, 0, 1, {0xC0}},             // enable clock and analog
+        {0x20, CommandBusyAfter, 0, {}},  // master activation
+        {0x3C, 0, 1, {0x01}},             // BorderWavefrom
+    };
+
+    static constexpr bool    kUploadLuts    = true;
+    static constexpr uint8_t kFullUpdate    = 0xC7;  // clock, analog, display mode 1, off again
+    static constexpr uint8_t kPartialUpdate = 0x0C;  // display mode 2 with the clock left on
+};
+
+// waveshare 2.9" v2, ssd1680 296x128, its waveforms are in the 153 byte ssd1680 layout so the
+// otp ones are used
+struct Panel290 {
+    static constexpr uint16_t kHeight = 296;
+    static constexpr uint16_t kWidth  = 128;
+
+    static constexpr Command kInit[] = {
+        {0x21, 0, 2, {0x00, 0x80}},  // display update control 1, source output mode
+        {0x3C, 0, 1, {0x05}},        // BorderWavefrom
+    };
+
+    // vcom and the display options stay as the otp waveform sets them
+    static constexpr Command kInitPartial[] = {
+        {0x22, 0, 1, {0xC0}},             // enable clock and analog
+        {0x20, CommandBusyAfter, 0, {}},  // master activation
+        {0x3C, 0, 1, {0x80}},             // BorderWavefrom, follow vcom
+    };
+
+    static constexpr bool    kUploadLuts    = false;
+    static constexpr uint8_t kFullUpdate    = 0xF7;  // also loads the temperature and otp lut
+    static constexpr uint8_t kPartialUpdate = 0xFF;  // display mode 2 with the otp lut
+};
+
+// waveshare 4.2" v2, ssd1683 400x300
+struct Panel420 {
+    static constexpr uint16_t kHeight = 300;
+    static constexpr uint16_t kWidth  = 400;
+
+    static constexpr Command kInit[] = {
+        {0x3C, 0, 1, {0x05}},  // BorderWavefrom
+    };
+
+    // vcom and the display options stay as the otp waveform sets them
+    static constexpr Command kInitPartial[] = {
+        {0x22, 0, 1, {0xC0}},             // enable clock and analog
+        {0x20, CommandBusyAfter, 0, {}},  // master activation
+        {0x3C, 0, 1, {0x80}},             // BorderWavefrom, follow vcom
+    };
+
+    static constexpr bool    kUploadLuts    = false;
+    static constexpr uint8_t kFullUpdate    = 0xF7;  // also loads the temperature and otp lut
+    static constexpr uint8_t kPartialUpdate = 0xFF;  // display mode 2 with the otp lut
+};
+
+}  // namespace epaper
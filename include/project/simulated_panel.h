@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "project/backend.h"
+
+namespace epaper {
+
+// ssd1680 style controller that decodes the command stream of the display driver into in memory
+// rams and models the busy timing, so the driver can run and be benchmarked off the pi
+class SimulatedPanel : public GpioBackend, public SpiBackend {
+   public:
+    // how long busy stays high after each operation
+    struct Timing {
+        int64_t reset_msec           = 10;    // hardware or soft reset
+        int64_t full_refresh_msec    = 2000;  // display mode 1
+        int64_t partial_refresh_msec = 300;   // display mode 2
+        int64_t other_msec           = 1;     // update sequences that don't drive the display
+    };
+
+    // everything the panel has seen since construction or the last ResetCounters
+    struct Counters {
+        uint64_t commands          = 0;  // command bytes
+        uint64_t data_bytes        = 0;  // data bytes
+        uint64_t transfers         = 0;  // spi writes
+        uint64_t pin_writes        = 0;  // gpio writes
+        uint64_t pin_toggles       = 0;  // gpio writes that changed the level
+        uint64_t resets            = 0;  // hardware and soft resets
+        uint64_t full_refreshes    = 0;
+        uint64_t partial_refreshes = 0;
+        uint64_t driven_pixels     = 0;  // pixels that differed between the rams in a partial
+        uint64_t lut_uploads       = 0;  // waveforms written with 0x32
+    };
+
+    // height in gates and width in pixels of the panel
+    SimulatedPanel(uint16_t height, uint16_t width);
+    SimulatedPanel(uint16_t height, uint16_t width, Timing timing, PanelPins pins = PanelPins());
+
+    bool    Setup(void) override;
+    void    SetMode(uint8_t pin, Mode mode) override;
+    void    Write(uint8_t pin, uint8_t value) override;
+    uint8_t Read(uint8_t pin) override;
+    bool    WaitForLow(uint8_t pin, int64_t msec) override;
+
+    bool Setup(uint8_t channel, uint32_t speed) override;
+    void Write(const uint8_t* data, size_t len) override;
+    bool Read(uint8_t* data, size_t len) override;
+
+    // rams and the shown image in the driver's image layout, the first row is the last gate
+    std::vector<uint8_t> Image(void) const;      // black/white ram (0x24)
+    std::vector<uint8_t> OldImage(void) const;   // red ram (0x26), old image for partial updates
+    std::vector<uint8_t> Displayed(void) const;  // black/white ram at the last refresh
+
+    const Counters& counters() const { return this->counters_; }
+    void            ResetCounters() { this->counters_ = Counters(); }
+
+    bool sleeping() const { return this->sleeping_; }  // in deep sleep until a hardware reset
+
+    // waveform last written with 0x32, empty after a reset
+    const std::vector<uint8_t>& waveform() const { return this->waveform_; }
+
+    // temperature the internal sensor reports, latched into the register by the 0x22 sequence
+    void SetTemperature(int8_t celsius) { this->temperature_ = celsius; }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    uint16_t  height_;
+    uint16_t  width_bound_;
+    Timing    timing_;
+    PanelPins pins_;
+
+    uint8_t dc_  = 0;
+    uint8_t cs_  = 1;
+    uint8_t rst_ = 1;
+
+    Clock::time_point busy_until_;
+    bool              sleeping_ = false;
+
+    // registers
+    uint8_t  entry_mode_;
+    uint16_t x_start_;
+    uint16_t x_end_;
+    uint16_t y_start_;
+    uint16_t y_end_;
+    uint16_t x_counter_;
+    uint16_t y_counter_;
+    uint8_t  update_control_;
+    bool     ping_pong_;
+    int8_t   temperature_register_;
+
+    std::vector<uint8_t> waveform_;
+    int8_t               temperature_ = 20;
+
+    uint8_t command_    = 0x00;  // last command received
+    size_t  data_index_ = 0;     // data bytes received since the command
+
+    std::vector<uint8_t> ram_bw_;
+    std::vector<uint8_t> ram_red_;
+    std::vector<uint8_t> displayed_;
+
+    Counters counters_;
+
+    void reset_registers_(void);                    // power on values of the registers
+    void set_busy_(int64_t msec);                   // hold busy high for msec from now
+    void on_command_(uint8_t command);              // start of a command
+    void on_data_(uint8_t data);                    // data byte for the last command
+    void write_ram_(std::vector<uint8_t>& ram, uint8_t data);  // write at counters and advance
+    std::vector<uint8_t> to_image_(const std::vector<uint8_t>& ram) const;  // flip to image rows
+};
+
+}  // namespace epaper
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "project/backend.h"
+
+namespace epaper {
+
+// trace files start with kTraceMagic and a version byte, followed by records of a type byte,
+// the microseconds since the previous record and the payload length as little endian base 128
+// varints, then the payload
+enum TraceRecord : uint8_t {
+    TraceCommand  = 0x01,  // command bytes, sent with dc low
+    TraceData     = 0x02,  // data bytes, sent with dc high
+    TraceReset    = 0x03,  // reset pin level
+    TraceBusyWait = 0x04,  // driver waited for busy to go low
+    TraceSpiSetup = 0x05,  // spi channel and little endian speed in hz
+};
+
+constexpr char    kTraceMagic[4] = {'E', 'P', 'T', 'R'};
+constexpr uint8_t kTraceVersion  = 1;
+
+// sits between the display driver and its backends and records every byte sent to the panel,
+// records go out to path at every reset and busy wait so a run that hangs or gets killed still
+// leaves its trace behind
+class TraceRecorder : public GpioBackend, public SpiBackend {
+   public:
+    TraceRecorder(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                  std::string path);
+    TraceRecorder(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                  std::string path, PanelPins pins);
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    bool    Setup(void) override;
+    void    SetMode(uint8_t pin, Mode mode) override;
+    void    Write(uint8_t pin, uint8_t value) override;
+    uint8_t Read(uint8_t pin) override;
+    bool    WaitForLow(uint8_t pin, int64_t msec) override;
+
+    bool Setup(uint8_t channel, uint32_t speed) override;
+    void Write(const uint8_t* data, size_t len) override;
+    bool Read(uint8_t* data, size_t len) override;
+
+    bool Flush(void);  // append the records so far to the trace, false if it can't be written
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kFlushBytes = 4096;  // records held back at most between flushes
+
+    std::shared_ptr<GpioBackend> gpio_;
+    std::shared_ptr<SpiBackend>  spi_;
+    std::string                  path_;
+    PanelPins                    pins_;
+
+    uint8_t           dc_ = 0;
+    Clock::time_point last_record_;
+
+    std::ofstream        file_;            // opened and truncated by the first flush
+    bool                 failed_ = false;  // the file couldn't be opened, records are dropped
+    std::vector<uint8_t> records_;         // not flushed yet
+
+    void record_(TraceRecord type, const uint8_t* payload, size_t len);
+};
+
+// sends a recorded trace to a panel, real or simulated, the same way the driver did
+class TraceReplayer {
+   public:
+    TraceReplayer(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi);
+    TraceReplayer(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                  PanelPins pins);
+
+    // replay the trace at path, paced keeps the recorded gaps between records instead of going
+    // as fast as the panel allows, false if the trace can't be read
+    bool Replay(const std::string& path, bool paced = false);
+
+   private:
+    // longest a recorded busy wait may take on replay
+    static constexpr int64_t kBusyTimeoutMsec = 10000;
+
+    std::shared_ptr<GpioBackend> gpio_;
+    std::shared_ptr<SpiBackend>  spi_;
+    PanelPins                    pins_;
+
+    void send_(uint8_t dc, const uint8_t* data, size_t len);  // one transfer with chip select
+};
+
+}  // namespace epaper
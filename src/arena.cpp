@@ -0,0 +1,35 @@
+#include "project/arena.h"
+
+namespace epaper {
+
+FrameArena::FrameArena(size_t capacity)
+    : buffer_(std::make_unique<uint8_t[]>(capacity)), capacity_(capacity) {}
+
+uint8_t* FrameArena::Allocate(size_t size, size_t alignment) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(this->buffer_.get()) + this->used_;
+    size_t    padding = (alignment - address % alignment) % alignment;
+
+    if (padding + size > this->capacity_ - this->used_) {
+        this->wanted_ += size + alignment - 1;
+        return nullptr;
+    }
+
+    uint8_t* block = this->buffer_.get() + this->used_ + padding;
+    this->used_ += padding + size;
+    this->wanted_ += padding + size;
+
+    return block;
+}
+
+void FrameArena::Reset(void) {
+    // only the first frames can outgrow it, after that a reset is just moving the offset back
+    if (this->wanted_ > this->capacity_) {
+        this->capacity_ = this->wanted_;
+        this->buffer_   = std::make_unique<uint8_t[]>(this->capacity_);
+    }
+
+    this->used_   = 0;
+    this->wanted_ = 0;
+}
+
+}  // namespace epaper
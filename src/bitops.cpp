@@ -0,0 +1,249 @@
+#include "project/bitops.h"
+
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace epaper {
+
+namespace bits {
+
+namespace {
+
+// one vector register of pixels, loads and stores are unaligned so rows at any offset work
+#if defined(__ARM_NEON)
+struct Simd {
+    using Vector = uint8x16_t;
+
+    static constexpr size_t      kWidth = 16;
+    static constexpr const char* kName  = "neon";
+
+    static Vector Load(const uint8_t* data) { return vld1q_u8(data); }
+    static void   Store(uint8_t* data, Vector v) { vst1q_u8(data, v); }
+    static Vector Splat(uint8_t value) { return vdupq_n_u8(value); }
+    static Vector And(Vector a, Vector b) { return vandq_u8(a, b); }
+    static Vector Or(Vector a, Vector b) { return vorrq_u8(a, b); }
+    static Vector Xor(Vector a, Vector b) { return veorq_u8(a, b); }
+
+    static bool Equal(Vector a, Vector b) {
+        uint64x2_t diff = vreinterpretq_u64_u8(veorq_u8(a, b));
+        return (vgetq_lane_u64(diff, 0) | vgetq_lane_u64(diff, 1)) == 0;
+    }
+};
+#elif defined(__AVX2__)
+struct Simd {
+    using Vector = __m256i;
+
+    static constexpr size_t      kWidth = 32;
+    static constexpr const char* kName  = "avx2";
+
+    static Vector Load(const uint8_t* data) {
+        return _mm256_loadu_si256(reinterpret_cast<const Vector*>(data));
+    }
+    static void Store(uint8_t* data, Vector v) {
+        _mm256_storeu_si256(reinterpret_cast<Vector*>(data), v);
+    }
+    static Vector Splat(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+    static Vector And(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+    static Vector Or(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+    static Vector Xor(Vector a, Vector b) { return _mm256_xor_si256(a, b); }
+
+    static bool Equal(Vector a, Vector b) {
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) == -1;
+    }
+};
+#elif defined(__SSE2__)
+struct Simd {
+    using Vector = __m128i;
+
+    static constexpr size_t      kWidth = 16;
+    static constexpr const char* kName  = "sse2";
+
+    static Vector Load(const uint8_t* data) {
+        return _mm_loadu_si128(reinterpret_cast<const Vector*>(data));
+    }
+    static void Store(uint8_t* data, Vector v) {
+        _mm_storeu_si128(reinterpret_cast<Vector*>(data), v);
+    }
+    static Vector Splat(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+    static Vector And(Vector a, Vector b) { return _mm_and_si128(a, b); }
+    static Vector Or(Vector a, Vector b) { return _mm_or_si128(a, b); }
+    static Vector Xor(Vector a, Vector b) { return _mm_xor_si128(a, b); }
+
+    static bool Equal(Vector a, Vector b) {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF;
+    }
+};
+#else
+// no vector unit (the pi zero's arm1176), a 64 bit word still moves 8 bytes at a time
+struct Simd {
+    using Vector = uint64_t;
+
+    static constexpr size_t      kWidth = 8;
+    static constexpr const char* kName  = "scalar";
+
+    static Vector Load(const uint8_t* data) {
+        Vector v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    static void   Store(uint8_t* data, Vector v) { std::memcpy(data, &v, sizeof(v)); }
+    static Vector Splat(uint8_t value) { return value * 0x0101010101010101ull; }
+    static Vector And(Vector a, Vector b) { return a & b; }
+    static Vector Or(Vector a, Vector b) { return a | b; }
+    static Vector Xor(Vector a, Vector b) { return a ^ b; }
+
+    static bool Equal(Vector a, Vector b) { return a == b; }
+};
+#endif
+
+constexpr size_t Simd::kWidth;
+
+struct AndOp {
+    static Simd::Vector Apply(Simd::Vector a, Simd::Vector b) { return Simd::And(a, b); }
+    static uint8_t      Apply(uint8_t a, uint8_t b) { return a & b; }
+};
+
+struct OrOp {
+    static Simd::Vector Apply(Simd::Vector a, Simd::Vector b) { return Simd::Or(a, b); }
+    static uint8_t      Apply(uint8_t a, uint8_t b) { return a | b; }
+};
+
+struct XorOp {
+    static Simd::Vector Apply(Simd::Vector a, Simd::Vector b) { return Simd::Xor(a, b); }
+    static uint8_t      Apply(uint8_t a, uint8_t b) { return a ^ b; }
+};
+
+// whole vectors first, the bytes left over one at a time
+template <typename Op>
+void apply(uint8_t* dst, const uint8_t* src, size_t len) {
+    size_t i = 0;
+    for (; i + Simd::kWidth <= len; i += Simd::kWidth) {
+        Simd::Store(&dst[i], Op::Apply(Simd::Load(&dst[i]), Simd::Load(&src[i])));
+    }
+    for (; i < len; i++) {
+        dst[i] = Op::Apply(dst[i], src[i]);
+    }
+}
+
+}  // namespace
+
+void Invert(uint8_t* data, size_t len) {
+    Simd::Vector ones = Simd::Splat(0xFF);
+
+    size_t i = 0;
+    for (; i + Simd::kWidth <= len; i += Simd::kWidth) {
+        Simd::Store(&data[i], Simd::Xor(Simd::Load(&data[i]), ones));
+    }
+    for (; i < len; i++) {
+        data[i] = ~data[i];
+    }
+}
+
+// libc's fill and copy are already vectorized for the target, and beat a plain vector loop
+// with their aligned and non-temporal stores
+void Fill(uint8_t* data, size_t len, uint8_t value) { std::memset(data, value, len); }
+
+void Copy(uint8_t* dst, const uint8_t* src, size_t len) { std::memcpy(dst, src, len); }
+
+void And(uint8_t* dst, const uint8_t* src, size_t len) { apply<AndOp>(dst, src, len); }
+
+void Or(uint8_t* dst, const uint8_t* src, size_t len) { apply<OrOp>(dst, src, len); }
+
+void Xor(uint8_t* dst, const uint8_t* src, size_t len) { apply<XorOp>(dst, src, len); }
+
+bool Equal(const uint8_t* a, const uint8_t* b, size_t len) {
+    size_t i = 0;
+    for (; i + Simd::kWidth <= len; i += Simd::kWidth) {
+        if (!Simd::Equal(Simd::Load(&a[i]), Simd::Load(&b[i]))) {
+            return false;
+        }
+    }
+    for (; i < len; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t Transpose8x8(uint64_t block) {
+    // swap the off diagonal 1x1, then 2x2, then 4x4 sub-blocks
+    uint64_t t = (block ^ (block >> 7)) & 0x00AA00AA00AA00AAull;
+    block ^= t ^ (t << 7);
+    t = (block ^ (block >> 14)) & 0x0000CCCC0000CCCCull;
+    block ^= t ^ (t << 14);
+    t = (block ^ (block >> 28)) & 0x00000000F0F0F0F0ull;
+    block ^= t ^ (t << 28);
+
+    return block;
+}
+
+uint8_t Reverse(uint8_t byte) {
+    byte = ((byte & 0xF0) >> 4) | ((byte & 0x0F) << 4);
+    byte = ((byte & 0xCC) >> 2) | ((byte & 0x33) << 2);
+    byte = ((byte & 0xAA) >> 1) | ((byte & 0x55) << 1);
+
+    return byte;
+}
+
+const char* Isa(void) { return Simd::kName; }
+
+namespace scalar {
+
+void Invert(uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        data[i] = ~data[i];
+    }
+}
+
+void Fill(uint8_t* data, size_t len, uint8_t value) {
+    for (size_t i = 0; i < len; i++) {
+        data[i] = value;
+    }
+}
+
+void Copy(uint8_t* dst, const uint8_t* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = src[i];
+    }
+}
+
+void And(uint8_t* dst, const uint8_t* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] &= src[i];
+    }
+}
+
+void Or(uint8_t* dst, const uint8_t* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+void Xor(uint8_t* dst, const uint8_t* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+bool Equal(const uint8_t* a, const uint8_t* b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace scalar
+
+}  // namespace bits
+
+}  // namespace epaper
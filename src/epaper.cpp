@@ -2,186 +2,1101 @@
 
 namespace epaper {
 
-void Epaper::set_gpio_mode_(int pin, GpioMode mode) {
-    // macros come from wiringpi library
-    if (mode == GpioModeInput) {
-        pinMode(pin, INPUT);
-        pullUpDnControl(pin, PUD_UP);
+template <typename Panel>
+constexpr uint16_t BasicEpaper<Panel>::kHeight;
+template <typename Panel>
+constexpr uint16_t BasicEpaper<Panel>::kWidth;
+template <typename Panel>
+constexpr size_t BasicEpaper<Panel>::kSpiChunkSize;
+template <typename Panel>
+constexpr uint16_t BasicEpaper<Panel>::kWindowOverhead;
+template <typename Panel>
+constexpr int64_t BasicEpaper<Panel>::kBusyTimeoutMsec;
+template <typename Panel>
+constexpr int64_t BasicEpaper<Panel>::kColdResetMsec;
+template <typename Panel>
+constexpr int64_t BasicEpaper<Panel>::kWarmResetMsec;
+template <typename Panel>
+constexpr uint16_t BasicEpaper<Panel>::kFrameSize;
+template <typename Panel>
+constexpr int8_t BasicEpaper<Panel>::kDefaultCelsius;
+template <typename Panel>
+constexpr int64_t BasicEpaper<Panel>::kBusyBucketMsec;
+template <typename Panel>
+constexpr int64_t BasicEpaper<Panel>::kBusyPollMsec;
+template <typename Panel>
+constexpr uint16_t BasicEpaper<Panel>::kHeightBound;
+template <typename Panel>
+constexpr uint16_t BasicEpaper<Panel>::kWidthBound;
+
+constexpr Command Panel213::kInit[];
+constexpr Command Panel290::kInit[];
+constexpr Command Panel420::kInit[];
+constexpr Command Panel213::kInitPartial[];
+constexpr Command Panel290::kInitPartial[];
+constexpr Command Panel420::kInitPartial[];
+
+namespace {
+
+template <typename T, size_t N>
+constexpr size_t length_of(const T (&)[N]) {
+    return N;
+}
+
+constexpr Command kSoftResetSequence[] = {
+    {0x12, CommandBusyBefore | CommandBusyAfter, 0, {}},
+};
+
+// registers for full updates set up from the panel dimensions, they come after the panel's own
+// init registers and none of them survive the reset needed to leave deep sleep
+template <typename Panel>
+struct InitFullSequence {
+    static constexpr uint8_t kLastGate0 = (Panel::kHeight - 1) & 0xFF;
+    static constexpr uint8_t kLastGate1 = (Panel::kHeight - 1) >> 8;
+    static constexpr uint8_t kLastByte  = (Panel::kWidth + 7) / 8 - 1;
+
+    static constexpr Command kCommands[] = {
+        {0x01, 0, 3, {kLastGate0, kLastGate1, 0x00}},           // Driver output control
+        {0x11, 0, 1, {0x01}},                                   // data entry mode
+        {0x44, 0, 2, {0x00, kLastByte}},                        // set Ram-X address start/end
+        {0x45, 0, 4, {kLastGate0, kLastGate1, 0x00, 0x00}},     // set Ram-Y address start/end
+        {0x4E, 0, 1, {0x00}},                                   // set RAM x address count to 0
+        {0x4F, CommandBusyAfter, 2, {kLastGate0, kLastGate1}},  // set RAM y address count
+    };
+};
+
+template <typename Panel>
+constexpr Command InitFullSequence<Panel>::kCommands[];
+
+// waveform and the voltages it was tuned with, kept until the next reset
+constexpr Command kLoadLutSequence[] = {
+    {0x03, CommandFromLut, 1, {70}},  // gate driving voltage
+    {0x04, CommandFromLut, 3, {71}},  // source driving voltage
+    {0x3A, CommandFromLut, 1, {74}},  // Dummy Line
+    {0x3B, CommandFromLut, 1, {75}},  // Gate time
+    {0x32, CommandFromLut, 70, {0}},  // waveform
+};
+
+// latch the internal sensor into the temperature register, 0xB1 would also load the otp
+// waveform over the uploaded one so only the temperature is loaded
+constexpr Command kLoadTemperatureSequence[] = {
+    {0x18, 0, 1, {0x80}},             // temperature sensor control, internal sensor
+    {0x22, 0, 1, {0xA1}},             // enable clock, load temperature, disable clock
+    {0x20, CommandBusyAfter, 0, {}},  // master activation
+};
+
+}  // namespace
+
+template <typename Panel>
+BasicEpaper<Panel>::BasicEpaper(std::shared_ptr<GpioBackend> gpio,
+                                std::shared_ptr<SpiBackend> spi, PanelConfig config)
+    : config_(std::move(config)), gpio_(std::move(gpio)), spi_(std::move(spi)) {}
+
+template <typename Panel>
+void BasicEpaper<Panel>::select_(void) {
+    // panels sharing the bus all see the clock and data lines, only one may be selected, dc is
+    // only driven while the lock is held since panels may share it too
+    if (this->config_.bus_lock) {
+        this->bus_guard_ = std::unique_lock<std::mutex>(*this->config_.bus_lock);
+        this->dc_        = kPinUnknown;  // another panel on the same dc line may have moved it
+    }
+    this->gpio_write_(this->config_.pins.cs, 0);
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::deselect_(void) {
+    this->gpio_write_(this->config_.pins.cs, 1);
+    if (this->bus_guard_.owns_lock()) {
+        this->bus_guard_.unlock();
+    }
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::gpio_write_(uint8_t pin, uint8_t value) {
+    // dc is set before every transfer but mostly already at the level it needs
+    if (pin == this->config_.pins.dc) {
+        if (value == this->dc_) {
+            return;
+        }
+        this->dc_ = value;
+    }
+
+    this->stats_.gpio_writes++;
+    this->gpio_->Write(pin, value);
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::spi_write_(const uint8_t* data, size_t len) {
+    this->stats_.transfers++;
+
+    // while dc is low every byte is a command, data bytes are counted for the last one
+    if (this->dc_ == 0) {
+        this->stats_.commands += len;
+        this->last_command_ = data[len - 1];
     } else {
-        pinMode(pin, OUTPUT);
+        this->stats_.data_bytes += len;
+        this->stats_.command_bytes[this->last_command_] += len;
     }
+
+    this->spi_->Write(data, len);
 }
 
-void Epaper::send_command_(uint8_t reg) {
-    digitalWrite(this->kPinDc, 0);
-    digitalWrite(this->kPinCs, 0);
-    wiringPiSPIDataRW(this->kSpiChannel, &reg, 1);
-    digitalWrite(this->kPinCs, 1);
+template <typename Panel>
+void BasicEpaper<Panel>::send_command_(uint8_t reg) {
+    this->select_();
+    this->gpio_write_(this->config_.pins.dc, 0);
+    this->spi_write_(&reg, 1);
+    this->deselect_();
 }
 
-void Epaper::send_data_(uint8_t data) {
-    digitalWrite(this->kPinDc, 1);
-    digitalWrite(this->kPinCs, 0);
-    wiringPiSPIDataRW(this->kSpiChannel, &data, 1);
-    digitalWrite(this->kPinCs, 1);
+template <typename Panel>
+void BasicEpaper<Panel>::send_data_(uint8_t data) {
+    this->select_();
+    this->gpio_write_(this->config_.pins.dc, 1);
+    this->spi_write_(&data, 1);
+    this->deselect_();
 }
 
-void Epaper::turn_display_on_(void) {
+template <typename Panel>
+void BasicEpaper<Panel>::send_data_(const uint8_t* data, size_t len) {
+    this->select_();
+    this->gpio_write_(this->config_.pins.dc, 1);
+    this->spi_write_(data, len);
+    this->deselect_();
+}
+
+template <typename Panel>
+bool BasicEpaper<Panel>::read_data_(uint8_t* data, size_t len) {
+    this->select_();
+    this->gpio_write_(this->config_.pins.dc, 1);
+    bool read = this->spi_->Read(data, len);
+    this->deselect_();
+
+    return read;
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::send_repeated_data_(uint8_t data, size_t len) {
+    std::fill_n(this->spi_buffer_, std::min(len, kSpiChunkSize), data);
+
+    this->select_();
+    this->gpio_write_(this->config_.pins.dc, 1);
+    while (len > 0) {
+        size_t chunk = std::min(len, kSpiChunkSize);
+        this->spi_write_(this->spi_buffer_, chunk);
+        len -= chunk;
+    }
+    this->deselect_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::run_sequence_(const Command* sequence, size_t length, const uint8_t* lut,
+                                       BusyOperation operation) {
+    // chip select stays low across commands, dc is sampled with the last bit of every byte
+    bool selected = false;
+
+    for (size_t i = 0; i < length; i++) {
+        const Command& command = sequence[i];
+
+        if ((command.flags & CommandBusyBefore) && selected) {
+            this->deselect_();
+            selected = false;
+        }
+        if (command.flags & CommandBusyBefore) {
+            this->BusyWait(operation);
+        }
+
+        if (!selected) {
+            this->select_();
+            selected = true;
+        }
+
+        this->gpio_write_(this->config_.pins.dc, 0);
+        this->spi_write_(&command.reg, 1);
+        if (command.length > 0) {
+            const uint8_t* data =
+                (command.flags & CommandFromLut) ? &lut[command.data[0]] : command.data;
+
+            this->gpio_write_(this->config_.pins.dc, 1);
+            this->spi_write_(data, command.length);
+        }
+
+        if (command.flags & CommandBusyAfter) {
+            this->deselect_();
+            selected = false;
+            this->BusyWait(operation);
+        }
+    }
+
+    if (selected) {
+        this->deselect_();
+    }
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::turn_display_on_(void) {
     this->send_command_(0x22);
-    this->send_data_(0xC7);
+    this->send_data_(Panel::kFullUpdate);
     this->send_command_(0x20);
-    this->BusyWait();
+    this->BusyWait(BusyFull);
+    this->count_refresh_(false);
+    this->sync_old_ram_();
 }
 
-void Epaper::SetUpIos() {
+template <typename Panel>
+void BasicEpaper<Panel>::turn_display_on_partial_(void) {
+    this->send_command_(0x22);
+    this->send_data_(Panel::kPartialUpdate);
+    this->send_command_(0x20);
+    this->BusyWait(BusyPartial);
+    this->count_refresh_(true);
+    this->sync_old_ram_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::sync_old_ram_(void) {
+    // the waveform picks each pixel's phases from its old (0x26) and new (0x24) ram bits, once
+    // refreshed the new bits are the old ones for the next update
+    if (this->old_ram_fill_pending_) {
+        // the pattern starts at the window, which still covers the last band written
+        this->set_ram_window_(this->to_ram_window_({0, 0, this->kHeight, this->kWidth}));
+        this->send_command_(0x46);  // auto write red ram
+        this->send_data_(this->old_ram_fill_value_ == 0xFF ? 0xF7 : 0x77);
+        this->BusyWait(BusyFill);
+    }
+
+    for (const RamWindow& window : this->old_ram_pending_) {
+        this->set_ram_window_(window);
+        this->send_command_(0x26);
+        this->send_window_(this->shadow_.data(), window);
+    }
+
+    this->old_ram_fill_pending_ = false;
+    this->old_ram_pending_.clear();
+}
+
+template <typename Panel>
+typename BasicEpaper<Panel>::RamWindow BasicEpaper<Panel>::to_ram_window_(Window window) const {
+    // the ends are summed wider than the window fields so a huge size can't wrap past the start
+    uint16_t height_end = static_cast<uint16_t>(
+        std::min<uint32_t>(uint32_t(window.height_start) + window.height, this->kHeight));
+    uint16_t width_end = static_cast<uint16_t>(
+        std::min<uint32_t>(uint32_t(window.width_start) + window.width, this->kWidth));
+
+    RamWindow ram;
+    ram.x_start = window.width_start / 8;
+    ram.x_end   = (width_end - 1) / 8;
+    ram.y_start = window.height_start;
+    ram.y_end   = height_end - 1;
+
+    return ram;
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::set_ram_window_(RamWindow window) {
+    // data entry mode counts y down from the last row, so image rows are mirrored in ram
+    uint16_t y_start = this->kHeightBound - 1 - window.y_start;
+    uint16_t y_end   = this->kHeightBound - 1 - window.y_end;
+
+    uint8_t x_start  = static_cast<uint8_t>(window.x_start);
+    uint8_t x_end    = static_cast<uint8_t>(window.x_end);
+    uint8_t y_start0 = static_cast<uint8_t>(y_start & 0xFF);
+    uint8_t y_start1 = static_cast<uint8_t>(y_start >> 8);
+    uint8_t y_end0   = static_cast<uint8_t>(y_end & 0xFF);
+    uint8_t y_end1   = static_cast<uint8_t>(y_end >> 8);
+
+    // one transfer per command with chip select held across them
+    const Command sequence[] = {
+        {0x44, 0, 2, {x_start, x_end}},                      // set Ram-X address start/end
+        {0x45, 0, 4, {y_start0, y_start1, y_end0, y_end1}},  // set Ram-Y address start/end
+        {0x4E, 0, 1, {x_start}},                             // set RAM x address count
+        {0x4F, 0, 2, {y_start0, y_start1}},                  // set RAM y address count
+    };
+    this->run_sequence_(sequence, length_of(sequence), nullptr);
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::send_window_(const uint8_t* image, RamWindow window) {
+    uint16_t row_size = window.x_end - window.x_start + 1;
+    size_t   staged   = 0;
+
+    // rows of the window are not contiguous in image so gather them before each transfer
+    this->select_();
+    this->gpio_write_(this->config_.pins.dc, 1);
+    for (uint16_t j = window.y_start; j <= window.y_end; j++) {
+        if (staged + row_size > kSpiChunkSize) {
+            this->spi_write_(this->spi_buffer_, staged);
+            staged = 0;
+        }
+
+        std::memcpy(&this->spi_buffer_[staged], &image[j * this->kWidthBound + window.x_start],
+                    row_size);
+        staged += row_size;
+    }
+
+    if (staged > 0) {
+        this->spi_write_(this->spi_buffer_, staged);
+    }
+    this->deselect_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::refresh_(void) {
+    if (this->update_mode_ == UpdateModePartial) {
+        this->turn_display_on_partial_();
+    } else {
+        this->turn_display_on_();
+    }
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::write_window_(const uint8_t* image, RamWindow window) {
+    this->set_ram_window_(window);
+    this->send_command_(0x24);
+    this->send_window_(image, window);
+    this->old_ram_pending_.push_back(window);
+
+    uint16_t row_size = window.x_end - window.x_start + 1;
+    for (uint16_t j = window.y_start; j <= window.y_end; j++) {
+        size_t offset = j * this->kWidthBound + window.x_start;
+        std::memcpy(&this->shadow_[offset], &image[offset], row_size);
+    }
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::fill_window_(RamWindow window, uint8_t value) {
+    bool full = window.x_start == 0 && window.x_end == this->kWidthBound - 1 &&
+                window.y_start == 0 && window.y_end == this->kHeightBound - 1;
+
+    if (this->kHardwareFill && full && (value == 0x00 || value == 0xFF)) {
+        // a regular pattern with steps as large as the ram fills all of it with the first step
+        // value, A[7] is the value and A[6:4]/A[2:0] the largest step height/width, it only
+        // covers the ram window so that has to be the whole ram again
+        this->set_ram_window_(window);
+        this->send_command_(0x47);  // auto write black/white ram
+        this->send_data_(value == 0xFF ? 0xF7 : 0x77);
+        this->BusyWait(BusyFill);
+
+        // the fill covers every window written before it
+        this->old_ram_fill_pending_ = true;
+        this->old_ram_fill_value_   = value;
+        this->old_ram_pending_.clear();
+    } else {
+        this->set_ram_window_(window);
+        this->send_command_(0x24);
+        this->send_repeated_data_(
+            value, (window.x_end - window.x_start + 1) * (window.y_end - window.y_start + 1));
+        this->old_ram_pending_.push_back(window);
+    }
+
+    for (uint16_t j = window.y_start; j <= window.y_end; j++) {
+        std::fill_n(&this->shadow_[j * this->kWidthBound + window.x_start],
+                    window.x_end - window.x_start + 1, value);
+    }
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::SetUpIos() {
     // init device connection
-    if (wiringPiSetupGpio() < 0) {
-        std::wcout << "failed to set up wiringpi library" << std::endl;
+    if (!this->gpio_->Setup()) {
+        std::wcout << "failed to set up gpio" << std::endl;
     }
 
-    this->set_gpio_mode_(this->kPinRst, GpioModeOutput);
-    this->set_gpio_mode_(this->kPinDc, GpioModeOutput);
-    this->set_gpio_mode_(this->kPinCs, GpioModeOutput);
-    this->set_gpio_mode_(this->kPinBusy, GpioModeInput);
+    this->gpio_->SetMode(this->config_.pins.rst, GpioBackend::kModeOutput);
+    this->gpio_->SetMode(this->config_.pins.dc, GpioBackend::kModeOutput);
+    this->gpio_->SetMode(this->config_.pins.cs, GpioBackend::kModeOutput);
+    this->gpio_->SetMode(this->config_.pins.busy, GpioBackend::kModeInput);
+    this->dc_ = kPinUnknown;
 
-    digitalWrite(this->kPinCs, 1);
+    this->gpio_write_(this->config_.pins.cs, 1);
 
-    wiringPiSPISetup(0, 10000000);
+    if (!this->spi_->Setup(this->config_.spi_channel, this->config_.spi_speed)) {
+        std::wcout << "failed to set up spi" << std::endl;
+    }
     this->Wait(200);
 }
 
-void Epaper::Shutdown() {
+template <typename Panel>
+void BasicEpaper<Panel>::Shutdown() {
     this->DeepSleep();
 
     // deinit device connection
     this->Wait(2000);
-    digitalWrite(this->kPinCs, GpioModeInput);
-    digitalWrite(this->kPinDc, GpioModeInput);
-    digitalWrite(this->kPinRst, GpioModeInput);
+
+    // other panels on the bus may still be running
+    std::unique_lock<std::mutex> lock;
+    if (this->config_.bus_lock) {
+        lock = std::unique_lock<std::mutex>(*this->config_.bus_lock);
+    }
+    this->gpio_write_(this->config_.pins.cs, 0);
+    this->gpio_write_(this->config_.pins.dc, 0);
+    this->gpio_write_(this->config_.pins.rst, 0);
 }
 
-void Epaper::InitFullUpdate(void) {
+template <typename Panel>
+void BasicEpaper<Panel>::InitFullUpdate(void) { this->init_full_(UpdateModeFull); }
+
+template <typename Panel>
+void BasicEpaper<Panel>::InitFastUpdate(void) { this->init_full_(UpdateModeFast); }
+
+template <typename Panel>
+void BasicEpaper<Panel>::init_full_(UpdateMode mode) {
     this->Reset();
+    this->run_sequence_(kSoftResetSequence, length_of(kSoftResetSequence), nullptr);
+    this->init_registers_();
 
-    this->BusyWait();
-    this->send_command_(0x12);  // soft reset
-    this->BusyWait();
+    this->update_mode_ = mode;
+    this->UpdateTemperature();
+}
 
-    this->send_command_(0x74);  // set analog block control
-    this->send_data_(0x54);
-    this->send_command_(0x7E);  // set digital block control
-    this->send_data_(0x3B);
+template <typename Panel>
+void BasicEpaper<Panel>::init_registers_(void) {
+    using Sequence = InitFullSequence<Panel>;
 
-    this->send_command_(0x01);  // Driver output control
-    this->send_data_(0xF9);
-    this->send_data_(0x00);
-    this->send_data_(0x00);
+    this->run_sequence_(Panel::kInit, length_of(Panel::kInit), nullptr);
+    this->run_sequence_(Sequence::kCommands, length_of(Sequence::kCommands), nullptr);
+}
 
-    this->send_command_(0x11);  // data entry mode
-    this->send_data_(0x01);
+template <typename Panel>
+void BasicEpaper<Panel>::InitPartialUpdate(void) {
+    // the partial registers go on top of the full update ones so no reset here
+    this->Wake();
+    this->run_sequence_(Panel::kInitPartial, length_of(Panel::kInitPartial), nullptr);
 
-    this->send_command_(0x44);  // set Ram-X address start/end position
-    this->send_data_(0x00);
-    this->send_data_(0x0F);  // 0x0C-->(15+1)*8=128
+    this->update_mode_ = UpdateModePartial;
+    this->load_lut_();
+}
 
-    this->send_command_(0x45);  // set Ram-Y address start/end position
-    this->send_data_(0xF9);     // 0xF9-->(249+1)=250
-    this->send_data_(0x00);
-    this->send_data_(0x00);
-    this->send_data_(0x00);
+template <typename Panel>
+void BasicEpaper<Panel>::Wake(void) {
+    if (!this->asleep_) {
+        return;
+    }
 
-    this->send_command_(0x3C);  // BorderWavefrom
-    this->send_data_(0x03);
+    // deep sleep kept the rams and so the shadow, but the reset to leave it cleared the
+    // registers, busy tells when the controller is ready so the reset can be short
+    this->reset_(kWarmResetMsec);
+    this->BusyWait(BusyInit);
 
-    this->send_command_(0x2C);  // VCOM Voltage
-    this->send_data_(0x55);
+    this->init_registers_();
+    if (this->update_mode_ == UpdateModePartial) {
+        this->run_sequence_(Panel::kInitPartial, length_of(Panel::kInitPartial), nullptr);
+    }
 
-    this->send_command_(0x03);
-    this->send_data_(this->kLutFullUpdate[70]);
+    // the panel may have cooled down or warmed up while asleep
+    this->UpdateTemperature();
+}
 
-    this->send_command_(0x04);  //
-    this->send_data_(this->kLutFullUpdate[71]);
-    this->send_data_(this->kLutFullUpdate[72]);
-    this->send_data_(this->kLutFullUpdate[73]);
+template <typename Panel>
+void BasicEpaper<Panel>::SetLuts(const LutRegistry& luts) {
+    this->luts_       = &luts;
+    this->loaded_lut_ = nullptr;
+}
 
-    this->send_command_(0x3A);  // Dummy Line
-    this->send_data_(this->kLutFullUpdate[74]);
-    this->send_command_(0x3B);  // Gate time
-    this->send_data_(this->kLutFullUpdate[75]);
+template <typename Panel>
+void BasicEpaper<Panel>::ForceTemperature(int8_t celsius) {
+    this->temperature_        = celsius;
+    this->temperature_forced_ = true;
+}
 
-    this->send_command_(0x32);
-    for (uint16_t i = 0; i < 70; i++) {
-        this->send_data_(this->kLutFullUpdate[i]);
+template <typename Panel>
+int8_t BasicEpaper<Panel>::UpdateTemperature(void) {
+    if (!this->temperature_forced_ && this->sensor_readable_) {
+        this->sensor_readable_ = this->read_temperature_();
     }
+    this->load_lut_();
 
-    this->send_command_(0x4E);  // set RAM x address count to 0;
-    this->send_data_(0x00);
-    this->send_command_(0x4F);  // set RAM y address count to 0X127;
-    this->send_data_(0xF9);
-    this->send_data_(0x00);
-    this->BusyWait();
+    return this->temperature_;
 }
 
-void Epaper::Reset(void) {
-    digitalWrite(this->kPinRst, 1);
-    this->Wait(200);
-    digitalWrite(this->kPinRst, 0);
+template <typename Panel>
+bool BasicEpaper<Panel>::read_temperature_(void) {
+    this->run_sequence_(kLoadTemperatureSequence, length_of(kLoadTemperatureSequence), nullptr,
+                        BusyTemperature);
+
+    uint8_t raw[2];
+    this->send_command_(0x1B);  // read temperature register
+    if (!this->read_data_(raw, sizeof(raw))) {
+        return false;
+    }
+
+    // 12 bit two's complement in 1/16 degrees, the first byte holds the whole degrees
+    this->temperature_ = static_cast<int8_t>(raw[0]);
+    return true;
+}
+
+template <typename Panel>
+LutKind BasicEpaper<Panel>::lut_kind_(void) const {
+    switch (this->update_mode_) {
+        case UpdateModePartial:
+            return LutKindPartial;
+        case UpdateModeFast:
+            return LutKindFast;
+        default:
+            return LutKindFull;
+    }
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::load_lut_(void) {
+    if (!Panel::kUploadLuts) {
+        return;  // the refresh loads the otp waveform
+    }
+
+    const Lut* lut = this->luts_->Find(this->lut_kind_(), this->temperature_);
+    if (lut == nullptr) {
+        std::wcout << "no waveform for " << static_cast<int>(this->temperature_) << " degrees"
+                   << std::endl;
+        return;
+    }
+
+    // temperatures in the same range share the waveform, only upload it when the range changed
+    if (lut->data == this->loaded_lut_) {
+        return;
+    }
+
+    this->run_sequence_(kLoadLutSequence, length_of(kLoadLutSequence), lut->data);
+    this->loaded_lut_ = lut->data;
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::Reset(void) { this->reset_(kColdResetMsec); }
+
+template <typename Panel>
+void BasicEpaper<Panel>::reset_(int64_t settle_msec) {
+    this->gpio_write_(this->config_.pins.rst, 1);
+    this->Wait(settle_msec);
+    this->gpio_write_(this->config_.pins.rst, 0);
     this->Wait(2);
-    digitalWrite(this->kPinRst, 1);
-    this->Wait(200);
+    this->gpio_write_(this->config_.pins.rst, 1);
+    this->Wait(settle_msec);
+
+    this->asleep_     = false;
+    this->loaded_lut_ = nullptr;
 }
 
-void Epaper::BusyWait(void) {
-    while (digitalRead(this->kPinBusy) == HIGH) {  // LOW: idle, HIGH: busy
-        this->Wait(50);
+template <typename Panel>
+void BasicEpaper<Panel>::BusyWait(BusyOperation operation) {
+    auto start    = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(kBusyTimeoutMsec);
+
+    // an operation that is already over skips the predicted sleep, how long it took isn't known
+    // so it isn't recorded either, the backend's wait still runs so traces see every wait
+    bool busy = this->gpio_->Read(this->config_.pins.busy) != 0;
+
+    // sleep through the part of the wait the operation has always taken, then poll finely until
+    // it has nearly always finished, the backend's own wait covers the rest
+    int64_t early = busy ? this->predict_busy_(operation, kBusyEarlyPercent) : -1;
+    if (early >= 0) {
+        int64_t late = this->predict_busy_(operation, kBusyLatePercent) + kBusyBucketMsec;
+
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(early));
+        while (this->gpio_->Read(this->config_.pins.busy) != 0 &&
+               std::chrono::steady_clock::now() < start + std::chrono::milliseconds(late)) {
+            this->stats_.busy_polls++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(kBusyPollMsec));
+        }
+    }
+
+    // LOW: idle, HIGH: busy
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    bool idle = this->gpio_->WaitForLow(this->config_.pins.busy,
+                                        std::max<int64_t>(remaining.count(), 0));
+    if (!idle) {
+        std::wcout << "timed out waiting for display to become idle" << std::endl;
     }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (idle && busy) {
+        this->record_busy_(operation,
+                           std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    }
+
+    this->stats_.busy_waits++;
+    this->stats_.busy_time += std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
 }
 
-void Epaper::ClearDisplay(void) {
-    this->send_command_(0x24);
-    for (uint8_t j = 0; j < this->kHeightBound; j++) {
-        for (uint8_t i = 0; i < this->kWidthBound; i++) {
-            this->send_data_(0XFF);
+template <typename Panel>
+void BasicEpaper<Panel>::record_busy_(BusyOperation operation, int64_t msec) {
+    BusyHistogram& histogram = this->busy_histograms_[operation];
+
+    // halving keeps the histogram following the panel as it ages or the weather changes
+    if (histogram.total >= kBusySamplesMax) {
+        histogram.total = 0;
+        for (uint16_t& count : histogram.counts) {
+            count /= 2;
+            histogram.total += count;
+        }
+    }
+
+    size_t bucket = std::min<size_t>(msec / kBusyBucketMsec, kBusyBuckets - 1);
+    histogram.counts[bucket]++;
+    histogram.total++;
+}
+
+template <typename Panel>
+int64_t BasicEpaper<Panel>::predict_busy_(BusyOperation operation, uint32_t percent) const {
+    const BusyHistogram& histogram = this->busy_histograms_[operation];
+    if (histogram.total < kBusySamplesMin) {
+        return -1;
+    }
+
+    // start of the bucket where percent of the samples have finished
+    uint32_t seen = 0;
+    for (size_t bucket = 0; bucket < kBusyBuckets; bucket++) {
+        seen += histogram.counts[bucket];
+        if (seen * 100 >= histogram.total * percent) {
+            return bucket * kBusyBucketMsec;
         }
     }
 
+    return (kBusyBuckets - 1) * kBusyBucketMsec;
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::ClearDisplay(void) {
+    this->Wake();
+
+    this->fill_window_(this->to_ram_window_({0, 0, this->kHeight, this->kWidth}), 0xFF);
+    this->shadow_valid_ = true;
+
     this->turn_display_on_();
 }
 
-void Epaper::DisplayImage(uint8_t* image) {
-    this->send_command_(0x24);
+template <typename Panel>
+void BasicEpaper<Panel>::FillRegion(Window window, uint8_t value) {
+    if (window.height == 0 || window.width == 0 || window.height_start >= this->kHeight ||
+        window.width_start >= this->kWidth) {
+        return;
+    }
+
+    this->Wake();
+    this->fill_window_(this->to_ram_window_(window), value);
+    this->refresh_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::DisplayImage(uint8_t* image) {
+    this->Wake();
+
+    if (!this->shadow_valid_) {
+        this->write_window_(image, this->to_ram_window_({0, 0, this->kHeight, this->kWidth}));
+        this->shadow_valid_ = true;
+        this->refresh_();
+        return;
+    }
+
+    // collect bands of changed rows, short runs of unchanged rows are cheaper to resend than
+    // setting up a new ram window
+    RamWindow band    = {0, 0, 0, 0};
+    bool      in_band = false;
+    bool      changed = false;
+    uint16_t  gap     = 0;
+
     for (uint16_t j = 0; j < this->kHeightBound; j++) {
-        for (uint16_t i = 0; i < this->kWidthBound; i++) {
-            this->send_data_(image[i + j * this->kWidthBound]);
+        const uint8_t* row    = &image[j * this->kWidthBound];
+        const uint8_t* shadow = &this->shadow_[j * this->kWidthBound];
+
+        if (bits::Equal(row, shadow, this->kWidthBound)) {
+            gap++;
+            continue;
+        }
+
+        uint16_t first = 0;
+        uint16_t last  = this->kWidthBound - 1;
+        while (row[first] == shadow[first]) {
+            first++;
+        }
+        while (row[last] == shadow[last]) {
+            last--;
         }
+
+        if (in_band && gap * (band.x_end - band.x_start + 1) > kWindowOverhead) {
+            this->write_window_(image, band);
+            in_band = false;
+        }
+
+        if (!in_band) {
+            band    = {first, last, j, j};
+            in_band = true;
+        } else {
+            band.x_start = std::min(band.x_start, first);
+            band.x_end   = std::max(band.x_end, last);
+            band.y_end   = j;
+        }
+
+        changed = true;
+        gap     = 0;
     }
+
+    if (!changed) {
+        return;  // panel already shows this frame
+    }
+
+    this->write_window_(image, band);
+    this->refresh_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::DisplayBaseImage(uint8_t* image) {
+    this->Wake();
+
+    // partial updates only drive the pixels that differ from the old ram, the refresh leaves the
+    // base image in both rams
+    this->write_window_(image, this->to_ram_window_({0, 0, this->kHeight, this->kWidth}));
+    this->shadow_valid_ = true;
+
     this->turn_display_on_();
 }
 
-void Epaper::DeepSleep(void) {
+template <typename Panel>
+void BasicEpaper<Panel>::DisplayPartial(uint8_t* image) {
+    this->Wake();
+
+    this->write_window_(image, this->to_ram_window_({0, 0, this->kHeight, this->kWidth}));
+    this->shadow_valid_ = true;
+
+    this->turn_display_on_partial_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::DisplayWindow(uint8_t* image, Window window) {
+    if (window.height == 0 || window.width == 0 || window.height_start >= this->kHeight ||
+        window.width_start >= this->kWidth) {
+        return;
+    }
+
+    this->Wake();
+    this->write_window_(image, this->to_ram_window_(window));
+    this->refresh_();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::DeepSleep(void) {
     this->send_command_(0x22);  // POWER OFF
     this->send_data_(0xC3);
     this->send_command_(0x20);
+    this->BusyWait(BusySleep);
 
-    this->send_command_(0x10);  // enter deep sleep
+    this->send_command_(0x10);  // enter deep sleep mode 1, keeps the rams
     this->send_data_(0x01);
     this->Wait(100);
+
+    this->asleep_ = true;
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::Wait(int64_t msec) {
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(msec));
+
+    this->stats_.waits++;
+    this->stats_.wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::ResetStats(void) {
+    this->stats_     = Stats();
+    this->last_dump_ = std::chrono::steady_clock::now();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::SetStatsDump(std::chrono::seconds period) {
+    this->dump_period_ = period;
+    this->last_dump_   = std::chrono::steady_clock::now();
+}
+
+template <typename Panel>
+void BasicEpaper<Panel>::DumpStats(std::wostream& out) const {
+    out << "refreshes: " << this->stats_.full_refreshes << " full, "
+        << this->stats_.partial_refreshes << " partial" << std::endl;
+    out << "spi: " << this->stats_.commands << " commands, " << this->stats_.data_bytes
+        << " data bytes in " << this->stats_.transfers << " transfers" << std::endl;
+    out << "gpio: " << this->stats_.gpio_writes << " writes" << std::endl;
+    out << "busy: " << this->stats_.busy_time.count() / 1000 << " ms in "
+        << this->stats_.busy_waits << " waits" << std::endl;
+    out << "sleep: " << this->stats_.wait_time.count() / 1000 << " ms in " << this->stats_.waits
+        << " waits" << std::endl;
+
+    for (size_t reg = 0; reg < this->stats_.command_bytes.size(); reg++) {
+        if (this->stats_.command_bytes[reg] > 0) {
+            out << "  0x" << std::hex << std::setw(2) << std::setfill(L'0') << reg << std::dec
+                << std::setfill(L' ') << ": " << this->stats_.command_bytes[reg] << " bytes"
+                << std::endl;
+        }
+    }
 }
 
-void Epaper::Wait(int64_t msec) { std::this_thread::sleep_for(std::chrono::milliseconds(msec)); }
+template <typename Panel>
+void BasicEpaper<Panel>::count_refresh_(bool partial) {
+    if (partial) {
+        this->stats_.partial_refreshes++;
+    } else {
+        this->stats_.full_refreshes++;
+    }
+
+    if (this->dump_period_.count() > 0 &&
+        std::chrono::steady_clock::now() - this->last_dump_ >= this->dump_period_) {
+        this->DumpStats(std::wcout);
+        this->last_dump_ = std::chrono::steady_clock::now();
+    }
+}
+
+template <typename Panel>
+constexpr uint16_t BasicRefreshPolicy<Panel>::kRegionRows;
+template <typename Panel>
+constexpr uint16_t BasicRefreshPolicy<Panel>::kRegionBytes;
+template <typename Panel>
+constexpr uint16_t BasicRefreshPolicy<Panel>::kRegionPixels;
+template <typename Panel>
+constexpr uint16_t BasicRefreshPolicy<Panel>::kWidthBound;
+template <typename Panel>
+constexpr uint16_t BasicRefreshPolicy<Panel>::kRegionsHigh;
+template <typename Panel>
+constexpr uint16_t BasicRefreshPolicy<Panel>::kRegionsWide;
+
+template <typename Panel>
+BasicRefreshPolicy<Panel>::BasicRefreshPolicy(Epaper& paper)
+    : BasicRefreshPolicy(paper, Budget()) {}
+
+template <typename Panel>
+BasicRefreshPolicy<Panel>::BasicRefreshPolicy(Epaper& paper, Budget budget)
+    : paper_(paper), budget_(budget) {
+    this->flips_.fill(0);
+}
+
+template <typename Panel>
+void BasicRefreshPolicy<Panel>::Display(uint8_t* image, std::chrono::system_clock::time_point now) {
+    if (!this->base_valid_ || this->quiet_hour_due_(now)) {
+        this->display_full_(image, now);
+        return;
+    }
+
+    // flips of this update are added to a copy so an update over budget starts from zero again
+    auto     flips   = this->flips_;
+    uint32_t changed = 0;
+    uint32_t limit   = this->budget_.flips_per_pixel * kRegionPixels;
+    bool     over    = false;
+
+    for (uint16_t j = 0; j < Epaper::kHeight; j++) {
+        if (bits::Equal(&this->base_[j * kWidthBound], &image[j * kWidthBound], kWidthBound)) {
+            continue;
+        }
+
+        for (uint16_t i = 0; i < kWidthBound; i++) {
+            size_t  idx  = j * kWidthBound + i;
+            uint8_t diff = this->base_[idx] ^ image[idx];
+            if (diff == 0) {
+                continue;
+            }
+
+            uint32_t& region = flips[(j / kRegionRows) * kRegionsWide + i / kRegionBytes];
+            uint32_t  count  = std::bitset<8>(diff).count();
+
+            region += count;
+            changed += count;
+            over = over || region > limit;
+        }
+    }
+
+    if (changed == 0) {
+        return;
+    }
+
+    if (over || this->partials_ >= this->budget_.partials) {
+        this->display_full_(image, now);
+        return;
+    }
+
+    // display_full_ left the paper in partial mode, only the bands of changed rows are sent
+    this->paper_.DisplayImage(image);
+    std::memcpy(this->base_.data(), image, Epaper::kFrameSize);
+    this->flips_ = flips;
+    this->partials_++;
+}
+
+template <typename Panel>
+uint32_t BasicRefreshPolicy<Panel>::MaxRegionFlips(void) const {
+    return *std::max_element(this->flips_.begin(), this->flips_.end());
+}
+
+template <typename Panel>
+bool BasicRefreshPolicy<Panel>::quiet_hour_due_(std::chrono::system_clock::time_point now) const {
+    if (this->budget_.quiet_hour < 0 || now - this->last_full_ < std::chrono::hours(1)) {
+        return false;
+    }
+
+    std::time_t time_temp = std::chrono::system_clock::to_time_t(now);
+    std::tm*    time_out  = std::localtime(&time_temp);
+
+    return time_out->tm_hour == this->budget_.quiet_hour;
+}
+
+template <typename Panel>
+void BasicRefreshPolicy<Panel>::display_full_(uint8_t* image,
+                                              std::chrono::system_clock::time_point now) {
+    // the full waveform drives every pixel through black and white, which clears the ghosting
+    this->paper_.InitFullUpdate();
+    this->paper_.DisplayBaseImage(image);
+    this->paper_.InitPartialUpdate();
+
+    std::memcpy(this->base_.data(), image, Epaper::kFrameSize);
+    this->base_valid_ = true;
+    this->partials_   = 0;
+    this->flips_.fill(0);
+    this->last_full_ = now;
+}
+
+template <typename Panel>
+BasicAsyncDisplay<Panel>::BasicAsyncDisplay(Epaper& paper)
+    : paper_(paper), worker_(&BasicAsyncDisplay::worker_loop_, this) {}
+
+template <typename Panel>
+BasicAsyncDisplay<Panel>::~BasicAsyncDisplay() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->stopping_ = true;
+    }
+    this->cv_.notify_one();
+    this->worker_.join();
+}
+
+template <typename Panel>
+std::future<void> BasicAsyncDisplay<Panel>::DisplayImage(const uint8_t* image) {
+    // the caller is free to render into its buffer again as soon as this returns
+    auto frame = std::make_shared<std::vector<uint8_t>>(image, image + Epaper::kFrameSize);
+
+    return this->Run([frame](Epaper& paper) { paper.DisplayImage(frame->data()); });
+}
+
+template <typename Panel>
+std::future<void> BasicAsyncDisplay<Panel>::ClearDisplay(void) {
+    return this->Run([](Epaper& paper) { paper.ClearDisplay(); });
+}
+
+template <typename Panel>
+std::future<void> BasicAsyncDisplay<Panel>::Run(std::function<void(Epaper&)> operation) {
+    std::packaged_task<void()> task([this, operation] { operation(this->paper_); });
+    std::future<void>          result = task.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->queue_.push_back(std::move(task));
+    }
+    this->cv_.notify_one();
+
+    return result;
+}
+
+template <typename Panel>
+void BasicAsyncDisplay<Panel>::worker_loop_(void) {
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex_);
+            this->cv_.wait(lock, [this] { return this->stopping_ || !this->queue_.empty(); });
+            if (this->queue_.empty()) {
+                return;  // stopping and nothing left to run
+            }
+
+            task = std::move(this->queue_.front());
+            this->queue_.pop_front();
+        }
+
+        task();
+    }
+}
+
+template <typename Panel>
+BasicEpaper<Panel>& BasicPanelGroup<Panel>::Add(std::shared_ptr<GpioBackend> gpio,
+                                                std::shared_ptr<SpiBackend> spi,
+                                                PanelConfig config) {
+    config.bus_lock = this->bus_lock_;
+
+    this->panels_.push_back(std::make_unique<Epaper>(std::move(gpio), std::move(spi), config));
+    this->workers_.push_back(std::make_unique<BasicAsyncDisplay<Panel>>(*this->panels_.back()));
+
+    return *this->panels_.back();
+}
+
+template <typename Panel>
+void BasicPanelGroup<Panel>::Run(std::function<void(Epaper&, size_t)> operation) {
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < this->workers_.size(); i++) {
+        results.push_back(this->workers_[i]->Run([operation, i](Epaper& paper) {
+            operation(paper, i);
+        }));
+    }
+
+    // wait for every display before rethrowing so none are still running on return
+    for (auto& result : results) {
+        result.wait();
+    }
+    for (auto& result : results) {
+        result.get();
+    }
+}
+
+template <typename Panel>
+void BasicPanelGroup<Panel>::SetUpIos(void) {
+    // one at a time, the gpio and spi libraries aren't set up concurrently
+    for (auto& panel : this->panels_) {
+        panel->SetUpIos();
+    }
+}
+
+template <typename Panel>
+void BasicPanelGroup<Panel>::InitFullUpdate(void) {
+    this->Run([](Epaper& paper, size_t) { paper.InitFullUpdate(); });
+}
+
+template <typename Panel>
+void BasicPanelGroup<Panel>::ClearDisplay(void) {
+    this->Run([](Epaper& paper, size_t) { paper.ClearDisplay(); });
+}
+
+template <typename Panel>
+void BasicPanelGroup<Panel>::DisplayImages(const std::vector<uint8_t*>& images) {
+    assert(images.size() == this->panels_.size());
+
+    this->Run([&images](Epaper& paper, size_t idx) { paper.DisplayImage(images[idx]); });
+}
+
+template class BasicEpaper<Panel213>;
+template class BasicEpaper<Panel290>;
+template class BasicEpaper<Panel420>;
+template class BasicRefreshPolicy<Panel213>;
+template class BasicRefreshPolicy<Panel290>;
+template class BasicRefreshPolicy<Panel420>;
+template class BasicAsyncDisplay<Panel213>;
+template class BasicAsyncDisplay<Panel290>;
+template class BasicAsyncDisplay<Panel420>;
+template class BasicPanelGroup<Panel213>;
+template class BasicPanelGroup<Panel290>;
+template class BasicPanelGroup<Panel420>;
+
+constexpr size_t Bitmap::kAlignment;
+constexpr size_t Bitmap::kInlineSize;
 
 Bitmap::Bitmap(uint16_t height, uint16_t width)
     : height_(height),
       width_(width),
       height_bound_(height),
-      width_bound_((width % 8 == 0) ? (width / 8) : (width / 8 + 1)) {
-    this->buffer_raw_ = std::make_unique<uint8_t[]>(this->width_bound_ * this->height_bound_);
-    this->buffer_     = std::make_unique<uint8_t*[]>(this->height_bound_);
-
-    for (uint16_t i = 0; i < this->height_bound_; i++) {
-        this->buffer_[i] = &this->buffer_raw_[i * this->width_bound_];
-    }
+      width_bound_((width % 8 == 0) ? (width / 8) : (width / 8 + 1)),
+      size_(static_cast<size_t>(this->height_bound_) * this->width_bound_) {
+    this->allocate_(nullptr);
+    this->ClearWhite();
+}
 
+Bitmap::Bitmap(uint16_t height, uint16_t width, FrameArena& arena)
+    : height_(height),
+      width_(width),
+      height_bound_(height),
+      width_bound_((width % 8 == 0) ? (width / 8) : (width / 8 + 1)),
+      size_(static_cast<size_t>(this->height_bound_) * this->width_bound_) {
+    this->allocate_(&arena);
     this->ClearWhite();
 }
 
@@ -189,14 +1104,9 @@ Bitmap::Bitmap(Bitmap&& move) noexcept
     : height_(move.height_),
       width_(move.width_),
       height_bound_(move.height_bound_),
-      width_bound_(move.width_bound_) {
-    move.height_       = 0;
-    move.width_        = 0;
-    move.height_bound_ = 0;
-    move.width_bound_  = 0;
-
-    this->buffer_raw_ = std::move(move.buffer_raw_);
-    this->buffer_     = std::move(move.buffer_);
+      width_bound_(move.width_bound_),
+      size_(move.size_) {
+    this->take_buffer_(move);
 }
 
 Bitmap& Bitmap::operator=(Bitmap&& move) noexcept {
@@ -204,76 +1114,289 @@ Bitmap& Bitmap::operator=(Bitmap&& move) noexcept {
         return *this;
     }
 
-    this->height_       = std::exchange(move.height_, 0);
-    this->width_        = std::exchange(move.width_, 0);
-    this->height_bound_ = std::exchange(move.height_bound_, 0);
-    this->width_bound_  = std::exchange(move.width_bound_, 0);
+    this->height_       = move.height_;
+    this->width_        = move.width_;
+    this->height_bound_ = move.height_bound_;
+    this->width_bound_  = move.width_bound_;
+    this->size_         = move.size_;
 
-    this->buffer_raw_ = std::move(move.buffer_raw_);
-    this->buffer_     = std::move(move.buffer_);
+    this->take_buffer_(move);
 
     return *this;
 }
 
-void Bitmap::ClearWhite() {
-    std::fill_n(this->buffer_raw_.get(), this->width_bound_ * this->height_bound_,
-                this->kWhiteBlock);
+void Bitmap::allocate_(FrameArena* arena) {
+    this->buffer_ = align_(this->inline_);
+    if (this->size_ <= kInlineSize) {
+        return;
+    }
+
+    this->buffer_ = arena ? arena->Allocate(this->size_, kAlignment) : nullptr;
+    if (this->buffer_ == nullptr) {
+        // one allocation for the whole image
+        this->heap_   = std::unique_ptr<uint8_t[]>(new uint8_t[this->size_ + kAlignment - 1]);
+        this->buffer_ = align_(this->heap_.get());
+    }
+}
+
+void Bitmap::take_buffer_(Bitmap& move) {
+    if (move.buffer_ == align_(move.inline_)) {
+        this->buffer_ = align_(this->inline_);
+        std::copy_n(move.buffer_, this->size_, this->buffer_);
+        this->heap_.reset();
+    } else {
+        this->buffer_ = move.buffer_;
+        this->heap_   = std::move(move.heap_);
+    }
+
+    move.height_       = 0;
+    move.width_        = 0;
+    move.height_bound_ = 0;
+    move.width_bound_  = 0;
+    move.size_         = 0;
+    move.buffer_       = align_(move.inline_);
+}
+
+uint8_t* Bitmap::align_(uint8_t* storage) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage);
+    return storage + (kAlignment - address % kAlignment) % kAlignment;
+}
+
+void Bitmap::ClearWhite() { bits::Fill(this->buffer_, this->size_, this->kWhiteBlock); }
+
+void Bitmap::ClearBlack() { bits::Fill(this->buffer_, this->size_, this->kBlackBlock); }
+
+void Bitmap::Invert() { bits::Invert(this->buffer_, this->size_); }
+
+uint8_t* Bitmap::Raw() { return this->buffer_; }
+
+const uint8_t* Bitmap::Raw() const { return this->buffer_; }
+
+Bitmap Bitmap::Rotated(Rotation rotation) const { return this->rotated_(rotation, nullptr); }
+
+Bitmap Bitmap::Rotated(Rotation rotation, FrameArena& arena) const {
+    return this->rotated_(rotation, &arena);
+}
+
+Bitmap Bitmap::Transposed() const {
+    Bitmap transposed(this->width_, this->height_);
+    this->transpose_into_(transposed, false, false);
+    return transposed;
 }
 
-void Bitmap::ClearBlack() {
-    std::fill_n(this->buffer_raw_.get(), this->width_bound_ * this->height_bound_,
-                this->kBlackBlock);
+Bitmap Bitmap::Transposed(FrameArena& arena) const {
+    Bitmap transposed(this->width_, this->height_, arena);
+    this->transpose_into_(transposed, false, false);
+    return transposed;
 }
 
-void Bitmap::Invert() {
-    for (int i = 0; i < this->height_bound_ * this->width_bound_; i++) {
-        this->buffer_raw_[i] = ~this->buffer_raw_[i];
+Bitmap Bitmap::rotated_(Rotation rotation, FrameArena* arena) const {
+    bool     turned = rotation == kRotation90 || rotation == kRotation270;
+    uint16_t height = turned ? this->width_ : this->height_;
+    uint16_t width  = turned ? this->height_ : this->width_;
+    Bitmap   rotated = arena ? Bitmap(height, width, *arena) : Bitmap(height, width);
+
+    switch (rotation) {
+        case kRotation0:
+            bits::Copy(rotated.buffer_, this->buffer_, this->size_);
+            break;
+        case kRotation90:
+            // the bottom row ends up as the first column
+            this->transpose_into_(rotated, true, false);
+            break;
+        case kRotation180:
+            this->rotate_180_into_(rotated);
+            break;
+        case kRotation270:
+            // the first column ends up as the bottom row
+            this->transpose_into_(rotated, false, true);
+            break;
+    }
+
+    return rotated;
+}
+
+void Bitmap::transpose_into_(Bitmap& dst, bool reverse_rows, bool reverse_dst_rows) const {
+    // block (i, j) covers rows 8i to 8i + 7 of this and byte j of each, it becomes rows 8j to
+    // 8j + 7 of dst and byte i of each
+    for (uint16_t i = 0; i < dst.width_bound_; i++) {
+        for (uint16_t j = 0; j < this->width_bound_; j++) {
+            uint64_t block = 0;
+            for (uint16_t y = 8 * i; y < 8 * i + 8; y++) {
+                uint16_t row  = reverse_rows ? this->height_ - 1 - y : y;
+                uint8_t  byte = (y < this->height_) ? (*this)(row, j) : 0x00;
+                block         = (block << 8) | byte;
+            }
+
+            block = bits::Transpose8x8(block);
+
+            for (uint16_t x = 8 * j; x < 8 * j + 8; x++) {
+                if (x < dst.height_) {
+                    uint16_t row = reverse_dst_rows ? dst.height_ - 1 - x : x;
+                    dst(row, i)  = block >> (56 - 8 * (x - 8 * j));
+                }
+            }
+        }
     }
 }
 
-uint8_t* Bitmap::Raw() { return this->buffer_raw_.get(); }
+void Bitmap::rotate_180_into_(Bitmap& dst) const {
+    // reversing the bytes of a row and the pixels in each puts the row padding in front, the
+    // row is then shifted left past it
+    uint16_t bytes   = this->width_bound_;
+    uint16_t padding = bytes * 8 - this->width_;
+
+    for (uint16_t j = 0; j < this->height_; j++) {
+        const uint8_t* row      = &(*this)(this->height_ - 1 - j, 0);
+        uint8_t*       reversed = &dst(j, 0);
+
+        for (uint16_t i = 0; i < bytes; i++) {
+            uint8_t high = bits::Reverse(row[bytes - 1 - i]) << padding;
+            uint8_t low  = (i + 1 < bytes && padding != 0)
+                               ? bits::Reverse(row[bytes - 2 - i]) >> (8 - padding)
+                               : 0x00;
+            reversed[i] = high | low;
+        }
+    }
+}
 
 void Bitmap::Print() const {
     for (uint16_t i = 0; i < this->height_bound_; i++) {
         for (uint16_t j = 0; j < this->width_bound_; j++) {
-            std::wcout << std::bitset<8>(this->buffer_[i][j]);
+            std::wcout << std::bitset<8>((*this)(i, j));
         }
 
         std::wcout << std::endl;
     }
 }
 
-uint8_t& Bitmap::operator[](size_t idx) { return this->buffer_raw_[idx]; }
+uint8_t& Bitmap::operator[](size_t idx) { return this->buffer_[idx]; }
 
-const uint8_t& Bitmap::operator[](size_t idx) const { return this->buffer_raw_[idx]; }
+const uint8_t& Bitmap::operator[](size_t idx) const { return this->buffer_[idx]; }
 
-uint8_t& Bitmap::operator()(size_t height, size_t width) { return this->buffer_[height][width]; }
+uint8_t& Bitmap::operator()(size_t height, size_t width) {
+    return this->buffer_[height * this->width_bound_ + width];
+}
 
 const uint8_t& Bitmap::operator()(size_t height, size_t width) const {
-    return this->buffer_[height][width];
+    return this->buffer_[height * this->width_bound_ + width];
+}
+
+namespace {
+
+// pixels are stored msb first, so a row read big endian is one long string of pixels that can be
+// shifted into place
+uint64_t load_be64(const uint8_t* data) {
+    uint64_t word = 0;
+    for (int i = 0; i < 8; i++) {
+        word = (word << 8) | data[i];
+    }
+    return word;
+}
+
+void store_be64(uint8_t* data, uint64_t word) {
+    for (int i = 7; i >= 0; i--) {
+        data[i] = word & 0xFF;
+        word >>= 8;
+    }
+}
+
+template <typename T>
+T render(T dst, T src, Renderer::RenderAction action) {
+    switch (action) {
+        case Renderer::kRenderActionAnd:
+            return dst & src;
+        case Renderer::kRenderActionOr:
+            return dst | src;
+        case Renderer::kRenderActionXor:
+            return dst ^ src;
+        default:
+            return src;
+    }
 }
 
+// only the bits set in mask are drawn
+uint8_t render_masked(uint8_t dst, uint8_t src, uint8_t mask, Renderer::RenderAction action) {
+    return (dst & ~mask) | (render(dst, src, action) & mask);
+}
+
+}  // namespace
+
 void Renderer::DrawOnImage(Bitmap& target, Bitmap& src, uint16_t start_height, uint16_t start_width,
                            RenderAction action) {
-    for (uint16_t i = 0; i < src.height_bound(); i++) {
-        for (uint16_t j = 0; j < src.width_bound(); j++) {
-            if (i + start_height >= target.height_bound() ||
-                j + start_width / 8 >= target.width_bound()) {
-                continue;
-            }
+    if (start_height >= target.height() || start_width >= target.width()) {
+        return;
+    }
+
+    // clip once up front, the padding bits at the end of src rows aren't drawn
+    uint16_t rows    = std::min<uint16_t>(src.height(), target.height() - start_height);
+    uint16_t columns = std::min<uint16_t>(src.width(), target.width() - start_width);
+    if (rows == 0 || columns == 0) {
+        return;
+    }
+
+    uint16_t end   = start_width + columns - 1;  // last target pixel
+    uint16_t first = start_width / 8;            // first and last target bytes
+    uint16_t last  = end / 8;
+    uint16_t shift = start_width % 8;            // src pixels move right by this much
+
+    uint8_t first_mask = 0xFF >> shift;
+    uint8_t last_mask  = 0xFF << (7 - end % 8);
+    if (first == last) {
+        first_mask &= last_mask;
+    }
+
+    uint16_t src_bytes = src.width_bound();
+
+    for (uint16_t i = 0; i < rows; i++) {
+        uint8_t*       dst = &target(i + start_height, 0);
+        const uint8_t* row = &src(i, 0);
+
+        // target byte first + k takes the low bits of src byte k - 1 and the high bits of k
+        auto shifted = [&](uint16_t k) -> uint8_t {
+            uint8_t high = (k < src_bytes) ? row[k] >> shift : 0;
+            uint8_t low  = (k > 0 && shift != 0) ? row[k - 1] << (8 - shift) : 0;
+            return high | low;
+        };
+
+        dst[first] = render_masked(dst[first], shifted(0), first_mask, action);
+        if (first == last) {
+            continue;
+        }
 
+        uint16_t d = first + 1;
+        if (shift == 0) {
+            // byte aligned, the inner bytes are a straight run for the kernels
+            uint16_t len = last - d;
             switch (action) {
                 case kRenderActionReplace:
-                    target(i + start_height, j + start_width / 8) = src(i, j);
+                    bits::Copy(&dst[d], &row[1], len);
                     break;
                 case kRenderActionAnd:
-                    target(i + start_height, j + start_width / 8) &= src(i, j);
+                    bits::And(&dst[d], &row[1], len);
                     break;
                 case kRenderActionOr:
-                    target(i + start_height, j + start_width / 8) |= src(i, j);
+                    bits::Or(&dst[d], &row[1], len);
+                    break;
+                case kRenderActionXor:
+                    bits::Xor(&dst[d], &row[1], len);
                     break;
             }
+            d = last;
+        }
+
+        // 8 inner bytes at a time while the src bytes they need are inside the row
+        for (; d + 8 <= last && d - first + 8 <= src_bytes; d += 8) {
+            uint16_t k    = d - first;
+            uint64_t word = (load_be64(&row[k]) >> shift) | (uint64_t(row[k - 1]) << (64 - shift));
+            store_be64(&dst[d], render(load_be64(&dst[d]), word, action));
         }
+
+        for (; d < last; d++) {
+            dst[d] = render_masked(dst[d], shifted(d - first), 0xFF, action);
+        }
+
+        dst[last] = render_masked(dst[last], shifted(last - first), last_mask, action);
     }
 }
 
@@ -289,7 +1412,8 @@ void TextRenderer::print_FT_Bitmap(FT_Bitmap* bitmap) const {
     ;
 }
 
-TextRenderer::TextRenderer(uint16_t size, std::string font) : size_(size), font_(font) {
+TextRenderer::TextRenderer(uint16_t size, std::string font)
+    : size_(size), font_(font), scratch_(0) {
     FT_Error error = FT_Init_FreeType(&this->library_);
     if (error) {
         std::wcout << "error" << std::endl;
@@ -314,8 +1438,16 @@ TextRenderer::~TextRenderer() {
     FT_Done_FreeType(this->library_);
 }
 
-Bitmap TextRenderer::RenderText(std::wstring const text) {
-    // render text with a 90 degree rotation
+Bitmap TextRenderer::RenderText(const std::wstring& text) {
+    return this->render_text_(text, nullptr);
+}
+
+Bitmap TextRenderer::RenderText(const std::wstring& text, FrameArena& arena) {
+    return this->render_text_(text, &arena);
+}
+
+Bitmap TextRenderer::render_text_(const std::wstring& text, FrameArena* arena) {
+    // render text with a 90 degree rotation, rows of the result are columns of the text
 
     FT_Bitmap* bitmap         = &this->slot_->bitmap;
     uint16_t   target_width   = 0;
@@ -347,52 +1479,62 @@ Bitmap TextRenderer::RenderText(std::wstring const text) {
         }
     }
 
-    Bitmap image = Bitmap(std::max(target_height, target_advance) * text.size(), target_width);
-    image.ClearBlack();
+    // the text is laid out upright, one glyph row per bitmap row, and turned at the end
+    uint16_t upright_width = std::max(target_height, target_advance) * text.size();
+    Bitmap   image(0, 0);
+    {
+        Bitmap upright = Bitmap(target_width, upright_width, this->scratch_);
+        upright.ClearBlack();
+
+        uint16_t x = 0;
+        for (auto const& character : text) {
+            // map the 8bit pixels to single bit pixels
+            FT_Error error = FT_Load_Char(this->face_, character, FT_LOAD_RENDER);
+            if (error) {
+                std::wcout << "error3" << std::endl;
+            }
 
-    uint16_t k = 0;
-    for (auto const& character : text) {
-        // map the 8bit pixels to single bit pixels
-        FT_Error error = FT_Load_Char(this->face_, character, FT_LOAD_RENDER);
-        if (error) {
-            std::wcout << "error3" << std::endl;
-        }
+            // space character does not get rendered
+            // just advance x by the columns it would take up
+            if (character == L' ') {
+                x += std::min(target_advance, target_height) / 2;
+                continue;
+            }
 
-        // space character does not get rendered
-        // just increment k by the characters it would take up
-        if (character == L' ') {
-            k += ((image.width_bound() * 8) * (std::min(target_advance, target_height) / 2));
-            continue;
-        }
+            // align all of the caracters on their base, requires shifing shorter characters down
+            // special case some characters for distinct alignment, otherwise align bottom
+            uint16_t start_padding = (target_width - bitmap->rows);
 
-        // align all of the caracters on their base, requires shifing shorter characters down (on
-        // correctly oriented image) add additional padding to the start of each row and take it
-        // away from the padding at the end
-        // special case some characters for distinct alignment, otherwise align bottom
-        uint16_t start_padding = (target_width - bitmap->rows);
+            if (character == L':' || character == L'-') {
+                start_padding /= 2;
+            } else if (character == L'°') {
+                start_padding = 0;
+            }
 
-        if (character == L':' || character == L'-') {
-            start_padding /= 2;
-        } else if (character == L'°') {
-            start_padding = 0;
-        }
+            for (uint16_t i = 0; i < bitmap->rows && start_padding + i < upright.height(); i++) {
+                uint8_t*       row   = &upright(start_padding + i, 0);
+                const uint8_t* glyph = &bitmap->buffer[bitmap->width * i];
 
-        for (uint16_t j = 0; j < bitmap->width; j++) {
-            k += start_padding;
-            for (uint16_t i = 0; i < bitmap->rows; i++) {
-                uint8_t val = (bitmap->buffer[bitmap->width * i + j] == 0) ? 0 : 1 << (7 - (k % 8));
-                image[k++ / 8] |= val;
+                for (uint16_t j = 0; j < bitmap->width && x + j < upright.width(); j++) {
+                    if (glyph[j] != 0) {
+                        row[(x + j) / 8] |= 0x80 >> ((x + j) % 8);
+                    }
+                }
             }
 
-            // add the width bound padding for byte to bit packing to the end
-            k += image.width_bound() * 8 - bitmap->rows - start_padding;
+            // pad the characters with the suggested width
+            x += bitmap->width + std::max<FT_Pos>((this->slot_->advance.x / 64) - bitmap->width, 1);
         }
 
-        // pad the characters with the suggested width
-        k += (image.width_bound() * 8) *
-             std::max(((this->slot_->advance.x / 64) - bitmap->width), 1ul);
+        // glyph columns become rows of the image, the same 90 degree turn as before the text was
+        // rendered upright
+        image = arena ? upright.Transposed(*arena) : upright.Transposed();
     }
 
+    // the upright layout is gone, a reset hands its space to the next call and grows the scratch
+    // if it didn't fit
+    this->scratch_.Reset();
+
     image.Invert();
 
     return image;
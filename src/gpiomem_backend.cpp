@@ -0,0 +1,179 @@
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include "project/backend.h"
+
+namespace epaper {
+
+constexpr size_t  GpiomemGpio::kMapSize;
+constexpr int64_t GpiomemGpio::kPollMsec;
+
+namespace {
+
+// register offsets in 32 bit words
+constexpr size_t kRegSelect   = 0x00 / 4;  // GPFSEL0, 3 bits per pin, 10 pins per register
+constexpr size_t kRegSet      = 0x1C / 4;  // GPSET0
+constexpr size_t kRegClear    = 0x28 / 4;  // GPCLR0
+constexpr size_t kRegLevel    = 0x34 / 4;  // GPLEV0
+constexpr size_t kRegPull     = 0x94 / 4;  // GPPUD, bcm2835 to bcm2837
+constexpr size_t kRegPullClk  = 0x98 / 4;  // GPPUDCLK0
+constexpr size_t kRegPull2711 = 0xE4 / 4;  // GPIO_PUP_PDN_CNTRL_REG0, 2 bits per pin
+
+// the soc's own gpio controller, its line offsets are the bcm gpio numbers
+constexpr const char* kChipPath  = "/dev/gpiochip0";
+constexpr const char* kChipLabel = "pinctrl-bcm2";
+
+}  // namespace
+
+GpiomemGpio::~GpiomemGpio() {
+    for (auto& edges : this->edge_fds_) {
+        close(edges.second);
+    }
+
+    if (this->registers_ != nullptr) {
+        munmap(const_cast<uint32_t*>(this->registers_), kMapSize);
+    }
+}
+
+bool GpiomemGpio::Setup(void) {
+    if (this->registers_ != nullptr) {
+        return true;
+    }
+
+    int fd = open("/dev/gpiomem", O_RDWR | O_SYNC);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::ifstream     compatible("/proc/device-tree/compatible");
+    const std::string model((std::istreambuf_iterator<char>(compatible)),
+                            std::istreambuf_iterator<char>());
+    this->bcm2711_ = model.find("bcm2711") != std::string::npos;
+
+    // the pi 5's gpio sits behind the rp1 with a different register layout
+    if (model.find("bcm2712") != std::string::npos) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, kMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    this->registers_ = static_cast<volatile uint32_t*>(map);
+
+    return true;
+}
+
+void GpiomemGpio::SetMode(uint8_t pin, Mode mode) {
+    volatile uint32_t& select = this->registers_[kRegSelect + pin / 10];
+    uint32_t           shift  = (pin % 10) * 3;
+
+    // 000 is input and 001 output
+    select = (select & ~(0x7u << shift)) | ((mode == kModeOutput ? 0x1u : 0x0u) << shift);
+
+    if (mode == kModeInput) {
+        this->request_edges_(pin);
+        this->set_pull_up_(pin);
+    }
+}
+
+void GpiomemGpio::Write(uint8_t pin, uint8_t value) {
+    // set and clear registers only change the pins with their bit set, no read modify write
+    this->registers_[(value != 0 ? kRegSet : kRegClear) + pin / 32] = 1u << (pin % 32);
+}
+
+uint8_t GpiomemGpio::Read(uint8_t pin) {
+    return (this->registers_[kRegLevel + pin / 32] >> (pin % 32)) & 0x1;
+}
+
+bool GpiomemGpio::WaitForLow(uint8_t pin, int64_t msec) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+    auto edges    = this->edge_fds_.find(pin);
+
+    // the kernel queues every edge since the request, so one between reading the pin and
+    // polling wakes the poll straight away
+    while (this->Read(pin) != 0) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            return false;
+        }
+
+        if (edges == this->edge_fds_.end()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollMsec));
+            continue;
+        }
+
+        pollfd events = {edges->second, POLLIN, 0};
+        if (poll(&events, 1, static_cast<int>(remaining.count()) + 1) > 0) {
+            gpioevent_data event;
+            if (read(edges->second, &event, sizeof(event)) < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(kPollMsec));
+            }
+        }
+    }
+
+    return true;
+}
+
+void GpiomemGpio::request_edges_(uint8_t pin) {
+    auto edges = this->edge_fds_.find(pin);
+    if (edges != this->edge_fds_.end()) {
+        close(edges->second);
+        this->edge_fds_.erase(edges);
+    }
+
+    int chip = open(kChipPath, O_RDONLY | O_CLOEXEC);
+    if (chip < 0) {
+        return;
+    }
+
+    gpiochip_info     info    = {};
+    gpioevent_request request = {};
+
+    request.lineoffset  = pin;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags  = GPIOEVENT_REQUEST_FALLING_EDGE;
+    std::strncpy(request.consumer_label, "epaper", sizeof(request.consumer_label) - 1);
+
+    if (ioctl(chip, GPIO_GET_CHIPINFO_IOCTL, &info) == 0 &&
+        std::strncmp(info.label, kChipLabel, std::strlen(kChipLabel)) == 0 &&
+        ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &request) == 0) {
+        this->edge_fds_[pin] = request.fd;
+    }
+
+    close(chip);
+}
+
+void GpiomemGpio::set_pull_up_(uint8_t pin) {
+    if (this->bcm2711_) {
+        volatile uint32_t& pull  = this->registers_[kRegPull2711 + pin / 16];
+        uint32_t           shift = (pin % 16) * 2;
+
+        pull = (pull & ~(0x3u << shift)) | (0x1u << shift);  // 01 is pull up
+        return;
+    }
+
+    // older chips latch the control value into the clocked pins after 150 cycles
+    this->registers_[kRegPull] = 0x2;  // pull up
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+    this->registers_[kRegPullClk + pin / 32] = 1u << (pin % 32);
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+    this->registers_[kRegPull]               = 0x0;
+    this->registers_[kRegPullClk + pin / 32] = 0;
+}
+
+}  // namespace epaper
@@ -0,0 +1,150 @@
+#include "project/lut.h"
+
+namespace epaper {
+
+namespace {
+
+// from the vendor's driver for the 2.13" v2, the same waveform at every temperature
+constexpr uint8_t kLutFullUpdate[kLutSize] = {
+    0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
+    0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
+    0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
+    0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
+
+    0x03, 0x03, 0x00, 0x00, 0x02,  // TP0 A~D RP0
+    0x09, 0x09, 0x00, 0x00, 0x02,  // TP1 A~D RP1
+    0x03, 0x03, 0x00, 0x00, 0x02,  // TP2 A~D RP2
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
+
+    0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
+};
+
+// hand tuned, the full update's phases run once instead of three times
+constexpr uint8_t kLutFastUpdate[kLutSize] = {
+    0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
+    0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
+    0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
+    0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
+
+    0x03, 0x03, 0x00, 0x00, 0x00,  // TP0 A~D RP0
+    0x09, 0x09, 0x00, 0x00, 0x00,  // TP1 A~D RP1
+    0x03, 0x03, 0x00, 0x00, 0x00,  // TP2 A~D RP2
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
+
+    0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
+};
+
+// hand tuned, longer phases and an extra repeat for the slower particles below 10 degrees
+constexpr uint8_t kLutFullUpdateCold[kLutSize] = {
+    0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
+    0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
+    0x80, 0x60, 0x40, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
+    0x10, 0x60, 0x20, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
+
+    0x05, 0x05, 0x00, 0x00, 0x03,  // TP0 A~D RP0
+    0x0F, 0x0F, 0x00, 0x00, 0x03,  // TP1 A~D RP1
+    0x05, 0x05, 0x00, 0x00, 0x03,  // TP2 A~D RP2
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
+
+    0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
+};
+
+// from the vendor's driver like the full update
+constexpr uint8_t kLutPartialUpdate[kLutSize] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
+    0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
+    0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
+
+    0x0A, 0x00, 0x00, 0x00, 0x00,  // TP0 A~D RP0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP1 A~D RP1
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP2 A~D RP2
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
+
+    0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
+};
+
+// hand tuned, the partial update's phase twice as long
+constexpr uint8_t kLutPartialUpdateCold[kLutSize] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT0: BB:     VS 0 ~7
+    0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT1: BW:     VS 0 ~7
+    0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT2: WB:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT3: WW:     VS 0 ~7
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // LUT4: VCOM:   VS 0 ~7
+
+    0x14, 0x00, 0x00, 0x00, 0x00,  // TP0 A~D RP0
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP1 A~D RP1
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP2 A~D RP2
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP3 A~D RP3
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP4 A~D RP4
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP5 A~D RP5
+    0x00, 0x00, 0x00, 0x00, 0x00,  // TP6 A~D RP6
+
+    0x15, 0x41, 0xA8, 0x32, 0x30, 0x0A,
+};
+
+constexpr int8_t kColdCelsius = 10;  // below this the cold waveforms are used
+
+LutRegistry make_default_registry(void) {
+    // the vendor has no fast waveform, a fast update is a full one unless opted in
+    LutRegistry registry;
+    registry.Add({LutKindFull, INT8_MIN, INT8_MAX, kLutFullUpdate});
+    registry.Add({LutKindPartial, INT8_MIN, INT8_MAX, kLutPartialUpdate});
+    registry.Add({LutKindFast, INT8_MIN, INT8_MAX, kLutFullUpdate});
+
+    return registry;
+}
+
+LutRegistry make_experimental_registry(void) {
+    LutRegistry registry = make_default_registry();
+    registry.Add({LutKindFull, INT8_MIN, kColdCelsius - 1, kLutFullUpdateCold});
+    registry.Add({LutKindPartial, INT8_MIN, kColdCelsius - 1, kLutPartialUpdateCold});
+
+    // short phases leave too much behind in the cold, fall back to the cold full update there
+    registry.Add({LutKindFast, INT8_MIN, INT8_MAX, kLutFastUpdate});
+    registry.Add({LutKindFast, INT8_MIN, kColdCelsius - 1, kLutFullUpdateCold});
+
+    return registry;
+}
+
+}  // namespace
+
+const LutRegistry& LutRegistry::Default() {
+    static const LutRegistry registry = make_default_registry();
+    return registry;
+}
+
+const LutRegistry& LutRegistry::Experimental() {
+    static const LutRegistry registry = make_experimental_registry();
+    return registry;
+}
+
+void LutRegistry::Add(Lut lut) { this->luts_.push_back(lut); }
+
+const Lut* LutRegistry::Find(LutKind kind, int8_t celsius) const {
+    for (auto it = this->luts_.rbegin(); it != this->luts_.rend(); ++it) {
+        if (it->kind == kind && it->min_celsius <= celsius && celsius <= it->max_celsius) {
+            return &*it;
+        }
+    }
+
+    return nullptr;
+}
+
+}  // namespace epaper
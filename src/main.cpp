@@ -7,11 +7,13 @@
 #include <algorithm>
 #include <array>
 #include <bitset>
+#include <cstdlib>
 #include <ctime>
 #include <cwctype>
 #include <iostream>
 
 #include "project/epaper.h"
+#include "project/trace.h"
 
 using namespace epaper;
 
@@ -22,6 +24,7 @@ constexpr uint16_t kStaticHeightOffset = 4;
 constexpr uint16_t kStaticWidthOffset = 12;
 constexpr uint16_t kZeroHeight = 0;
 constexpr uint16_t kZeroWidth = 0;
+constexpr size_t   kFrameArenaSize = 16 * 1024;  // the rendered text of a frame fits with room
 
 std::wstring get_timestring() {
     const static std::wstring DAY[]   = {L"Sunday",   L"Monday", L"Tuesday", L"Wednesday",
@@ -53,58 +56,86 @@ int main(void) {
         return -1;
     }
 
-    auto paper = Epaper();
+    // the mapped registers are much faster and busy still waits on the falling edge through
+    // the gpio character device, wiringpi also runs on pis they don't cover
+    auto                         gpiomem = std::make_shared<GpiomemGpio>();
+    std::shared_ptr<GpioBackend> gpio    = gpiomem;
+    if (!gpiomem->Setup()) {
+        gpio = std::make_shared<WiringPiGpio>();
+    }
+
+    std::shared_ptr<SpiBackend> spi = std::make_shared<SpidevSpi>();
+
+    // EPAPER_TRACE=<file> records the command stream to replay it off the pi
+    if (const char* trace_path = std::getenv("EPAPER_TRACE")) {
+        auto recorder = std::make_shared<TraceRecorder>(gpio, spi, trace_path);
+        gpio          = recorder;
+        spi           = recorder;
+    }
+
+    Epaper paper(gpio, spi);
 
     paper.SetUpIos();
 
-    paper.InitFullUpdate();
-    paper.ClearDisplay();
-    paper.Wait(200);
+    // the display initializes and clears while the frame is rendered
+    AsyncDisplay display(paper);
+    display.Run([](Epaper& p) {
+        p.InitFullUpdate();
+        p.ClearDisplay();
+        p.Wait(200);
+    });
 
     auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
 
-    auto weather_renderer = TextRenderer(kWeatherFontSize, TextRenderer::Fonts::kWeather);
-    auto text_renderer    = TextRenderer(kTextFontSize, TextRenderer::Fonts::kLetterBoard);
+    // the rendered text is only needed until it is drawn onto the frame
+    FrameArena arena(kFrameArenaSize);
+
+    // closes before the arena is reset so no rendered text outlives its memory
+    {
+        TextRenderer weather_renderer(kWeatherFontSize, TextRenderer::Fonts::kWeather);
+        TextRenderer text_renderer(kTextFontSize, TextRenderer::Fonts::kLetterBoard);
 
-    auto time = text_renderer.RenderText(get_timestring());
-    weather_renderer.DrawOnImage(image, time, kZeroHeight, Epaper::kWidth - time.width());
+        auto time = text_renderer.RenderText(get_timestring(), arena);
+        weather_renderer.DrawOnImage(image, time, kZeroHeight, Epaper::kWidth - time.width());
 
-    auto weather = weather_renderer.RenderText(forecast->icons[0]);
-    weather_renderer.DrawOnImage(image, weather, kZeroHeight,
-                                 ((Epaper::kWidth - time.width()) - weather.width()) / 2);
+        auto weather = weather_renderer.RenderText(forecast->icons[0], arena);
+        weather_renderer.DrawOnImage(image, weather, kZeroHeight,
+                                     ((Epaper::kWidth - time.width()) - weather.width()) / 2);
 
-    auto description = text_renderer.RenderText(std::to_wstring(forecast->temperatures[0]) + L"° " +
-                                                forecast->description);
-    weather_renderer.DrawOnImage(image, description, weather.height() + kStaticHeightOffset - 2, kZeroWidth);
+        auto description = text_renderer.RenderText(std::to_wstring(forecast->temperatures[0]) + L"° " +
+                                                    forecast->description, arena);
+        weather_renderer.DrawOnImage(image, description, weather.height() + kStaticHeightOffset - 2, kZeroWidth);
 
-    auto smaller_weather_renderer = TextRenderer(kSubTextFontSize, TextRenderer::Fonts::kWeather);
-    auto text_lower = text_renderer.RenderText(std::to_wstring(forecast->temperatures[1]) + L"°");
-    auto text_lower_icon = smaller_weather_renderer.RenderText(forecast->icons[1]);
+        TextRenderer smaller_weather_renderer(kSubTextFontSize, TextRenderer::Fonts::kWeather);
+        auto text_lower = text_renderer.RenderText(std::to_wstring(forecast->temperatures[1]) + L"°", arena);
+        auto text_lower_icon = smaller_weather_renderer.RenderText(forecast->icons[1], arena);
 
-    auto offset = weather.height() + kStaticHeightOffset;
-    weather_renderer.DrawOnImage(image, text_lower_icon, offset, description.width() + kStaticWidthOffset);
+        auto offset = weather.height() + kStaticHeightOffset;
+        weather_renderer.DrawOnImage(image, text_lower_icon, offset, description.width() + kStaticWidthOffset);
 
-    offset += text_lower_icon.height() + kStaticHeightOffset;
-    weather_renderer.DrawOnImage(image, text_lower, offset, description.width() + kStaticWidthOffset);
+        offset += text_lower_icon.height() + kStaticHeightOffset;
+        weather_renderer.DrawOnImage(image, text_lower, offset, description.width() + kStaticWidthOffset);
 
-    text_lower      = text_renderer.RenderText(std::to_wstring(forecast->temperatures[2]) + L"°");
-    text_lower_icon = smaller_weather_renderer.RenderText(forecast->icons[2]);
+        text_lower      = text_renderer.RenderText(std::to_wstring(forecast->temperatures[2]) + L"°", arena);
+        text_lower_icon = smaller_weather_renderer.RenderText(forecast->icons[2], arena);
 
-    offset += text_lower.height() + kStaticHeightOffset;
-    weather_renderer.DrawOnImage(image, text_lower_icon, offset, description.width() + kStaticWidthOffset);
+        offset += text_lower.height() + kStaticHeightOffset;
+        weather_renderer.DrawOnImage(image, text_lower_icon, offset, description.width() + kStaticWidthOffset);
 
-    offset += text_lower_icon.height() + kStaticHeightOffset;
-    weather_renderer.DrawOnImage(image, text_lower, offset, description.width() + kStaticWidthOffset);
+        offset += text_lower_icon.height() + kStaticHeightOffset;
+        weather_renderer.DrawOnImage(image, text_lower, offset, description.width() + kStaticWidthOffset);
+    }
 
     image.Print();
 
-    paper.DisplayImage(image.Raw());
+    display.DisplayImage(image.Raw()).wait();
+    arena.Reset();
 
     std::wcout << "Press <Enter> to continue..." << std::endl;
     std::wcin.get();
 
-    paper.ClearDisplay();
-    paper.Shutdown();
+    display.ClearDisplay();
+    display.Run([](Epaper& p) { p.Shutdown(); }).wait();
 
     return 0;
 }
@@ -0,0 +1,304 @@
+#include "project/simulated_panel.h"
+
+#include <algorithm>
+#include <bitset>
+#include <thread>
+
+namespace epaper {
+
+SimulatedPanel::SimulatedPanel(uint16_t height, uint16_t width)
+    : SimulatedPanel(height, width, Timing()) {}
+
+SimulatedPanel::SimulatedPanel(uint16_t height, uint16_t width, Timing timing, PanelPins pins)
+    : height_(height),
+      width_bound_((width % 8 == 0) ? (width / 8) : (width / 8 + 1)),
+      timing_(timing),
+      pins_(pins),
+      busy_until_(Clock::now()),
+      ram_bw_(height * this->width_bound_, 0xFF),
+      ram_red_(height * this->width_bound_, 0xFF),
+      displayed_(height * this->width_bound_, 0xFF) {
+    this->reset_registers_();
+}
+
+bool SimulatedPanel::Setup(void) { return true; }
+
+void SimulatedPanel::SetMode(uint8_t pin, Mode mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void SimulatedPanel::Write(uint8_t pin, uint8_t value) {
+    this->counters_.pin_writes++;
+
+    if (pin == this->pins_.dc) {
+        this->counters_.pin_toggles += this->dc_ != value;
+        this->dc_ = value;
+    } else if (pin == this->pins_.cs) {
+        this->counters_.pin_toggles += this->cs_ != value;
+        this->cs_ = value;
+    } else if (pin == this->pins_.rst) {
+        this->counters_.pin_toggles += this->rst_ != value;
+        // the controller resets on the rising edge after holding reset low
+        if (this->rst_ == 0 && value != 0) {
+            this->counters_.resets++;
+            this->sleeping_ = false;
+            this->reset_registers_();
+            this->set_busy_(this->timing_.reset_msec);
+        }
+        this->rst_ = value;
+    }
+}
+
+uint8_t SimulatedPanel::Read(uint8_t pin) {
+    if (pin == this->pins_.busy) {
+        return Clock::now() < this->busy_until_ ? 1 : 0;
+    }
+
+    return 0;
+}
+
+bool SimulatedPanel::WaitForLow(uint8_t pin, int64_t msec) {
+    if (pin != this->pins_.busy) {
+        return true;
+    }
+
+    auto deadline = Clock::now() + std::chrono::milliseconds(msec);
+    std::this_thread::sleep_until(std::min(deadline, this->busy_until_));
+
+    return this->Read(pin) == 0;
+}
+
+bool SimulatedPanel::Setup(uint8_t channel, uint32_t speed) {
+    (void)channel;
+    (void)speed;
+    return true;
+}
+
+void SimulatedPanel::Write(const uint8_t* data, size_t len) {
+    this->counters_.transfers++;
+
+    // bytes are only clocked in while selected and not in deep sleep
+    if (this->cs_ != 0 || this->sleeping_) {
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (this->dc_ == 0) {
+            this->on_command_(data[i]);
+        } else {
+            this->on_data_(data[i]);
+        }
+    }
+}
+
+bool SimulatedPanel::Read(uint8_t* data, size_t len) {
+    if (this->cs_ != 0 || this->sleeping_ || this->dc_ == 0) {
+        return false;
+    }
+
+    // only the temperature register is modelled, everything else reads back as zero
+    std::fill_n(data, len, 0x00);
+    if (this->command_ == 0x1B && len > 0) {
+        data[0] = static_cast<uint8_t>(this->temperature_register_);
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> SimulatedPanel::Image(void) const { return this->to_image_(this->ram_bw_); }
+
+std::vector<uint8_t> SimulatedPanel::OldImage(void) const {
+    return this->to_image_(this->ram_red_);
+}
+
+std::vector<uint8_t> SimulatedPanel::Displayed(void) const {
+    return this->to_image_(this->displayed_);
+}
+
+void SimulatedPanel::reset_registers_(void) {
+    this->entry_mode_     = 0x03;  // x and y increment
+    this->x_start_        = 0;
+    this->x_end_          = this->width_bound_ - 1;
+    this->y_start_        = 0;
+    this->y_end_          = this->height_ - 1;
+    this->x_counter_      = 0;
+    this->y_counter_      = 0;
+    this->update_control_ = 0xFF;
+    this->ping_pong_      = false;
+
+    this->temperature_register_ = 0;
+    this->waveform_.clear();
+}
+
+void SimulatedPanel::set_busy_(int64_t msec) {
+    this->busy_until_ = Clock::now() + std::chrono::milliseconds(msec);
+}
+
+void SimulatedPanel::on_command_(uint8_t command) {
+    this->counters_.commands++;
+    this->command_    = command;
+    this->data_index_ = 0;
+
+    switch (command) {
+        case 0x12:  // soft reset
+            this->counters_.resets++;
+            this->reset_registers_();
+            this->set_busy_(this->timing_.reset_msec);
+            break;
+        case 0x20:  // master activation, runs the sequence set with 0x22
+            if (this->update_control_ & 0x20) {
+                this->temperature_register_ = this->temperature_;
+            }
+
+            if ((this->update_control_ & 0x04) == 0) {
+                this->set_busy_(this->timing_.other_msec);
+            } else if (this->update_control_ & 0x08) {  // display mode 2
+                // the partial waveform only drives pixels whose old and new ram bits differ
+                this->counters_.partial_refreshes++;
+                for (size_t i = 0; i < this->displayed_.size(); i++) {
+                    uint8_t changed = this->ram_red_[i] ^ this->ram_bw_[i];
+                    this->displayed_[i] =
+                        (this->displayed_[i] & ~changed) | (this->ram_bw_[i] & changed);
+                    this->counters_.driven_pixels += std::bitset<8>(changed).count();
+                }
+                if (this->ping_pong_) {
+                    this->ram_red_ = this->ram_bw_;
+                }
+                this->set_busy_(this->timing_.partial_refresh_msec);
+            } else {
+                this->counters_.full_refreshes++;
+                this->displayed_ = this->ram_bw_;
+                this->set_busy_(this->timing_.full_refresh_msec);
+            }
+            break;
+        case 0x32:  // write lut register
+            this->counters_.lut_uploads++;
+            this->waveform_.clear();
+            break;
+        default:
+            break;
+    }
+}
+
+void SimulatedPanel::on_data_(uint8_t data) {
+    this->counters_.data_bytes++;
+    size_t index = this->data_index_++;
+
+    switch (this->command_) {
+        case 0x10:  // deep sleep mode
+            this->sleeping_ = (data & 0x03) != 0;
+            break;
+        case 0x11:  // data entry mode
+            this->entry_mode_ = data & 0x07;
+            break;
+        case 0x22:  // display update control 2
+            this->update_control_ = data;
+            break;
+        case 0x24:  // write black/white ram
+            this->write_ram_(this->ram_bw_, data);
+            break;
+        case 0x26:  // write red ram
+            this->write_ram_(this->ram_red_, data);
+            break;
+        case 0x46:  // auto write red ram for regular pattern
+        case 0x47: {  // auto write black/white ram for regular pattern
+            // only patterns with steps as large as the ram are modelled, they fill the ram window
+            // with the first step value
+            std::vector<uint8_t>& ram = (this->command_ == 0x46) ? this->ram_red_ : this->ram_bw_;
+            uint16_t x_low  = std::min(this->x_start_, this->x_end_);
+            uint16_t x_high = std::min<uint16_t>(std::max(this->x_start_, this->x_end_),
+                                                 this->width_bound_ - 1);
+            uint16_t y_low  = std::min(this->y_start_, this->y_end_);
+            uint16_t y_high = std::min<uint16_t>(std::max(this->y_start_, this->y_end_),
+                                                 this->height_ - 1);
+            for (uint16_t j = y_low; j <= y_high && x_low <= x_high; j++) {
+                std::fill_n(&ram[j * this->width_bound_ + x_low], x_high - x_low + 1,
+                            (data & 0x80) ? 0xFF : 0x00);
+            }
+            this->set_busy_(this->timing_.other_msec);
+            break;
+        }
+        case 0x32:  // write lut register
+            this->waveform_.push_back(data);
+            break;
+        case 0x37:  // display option, ping-pong for display mode 2 is bit 6 of the fifth byte
+            if (index == 4) {
+                this->ping_pong_ = (data & 0x40) != 0;
+            }
+            break;
+        case 0x44:  // ram x start/end
+            if (index == 0) {
+                this->x_start_ = data & 0x3F;
+            } else if (index == 1) {
+                this->x_end_ = data & 0x3F;
+            }
+            break;
+        case 0x45:  // ram y start/end, low byte then high bit
+            if (index == 0) {
+                this->y_start_ = data;
+            } else if (index == 1) {
+                this->y_start_ |= (data & 0x01) << 8;
+            } else if (index == 2) {
+                this->y_end_ = data;
+            } else if (index == 3) {
+                this->y_end_ |= (data & 0x01) << 8;
+            }
+            break;
+        case 0x4E:  // ram x counter
+            this->x_counter_ = data & 0x3F;
+            break;
+        case 0x4F:  // ram y counter, low byte then high bit
+            if (index == 0) {
+                this->y_counter_ = data;
+            } else if (index == 1) {
+                this->y_counter_ |= (data & 0x01) << 8;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void SimulatedPanel::write_ram_(std::vector<uint8_t>& ram, uint8_t data) {
+    if (this->x_counter_ < this->width_bound_ && this->y_counter_ < this->height_) {
+        ram[this->y_counter_ * this->width_bound_ + this->x_counter_] = data;
+    }
+
+    // counters move inside the window and wrap to the other side when they leave it
+    uint16_t x_low  = std::min(this->x_start_, this->x_end_);
+    uint16_t x_high = std::max(this->x_start_, this->x_end_);
+    uint16_t y_low  = std::min(this->y_start_, this->y_end_);
+    uint16_t y_high = std::max(this->y_start_, this->y_end_);
+    bool     next_y = false;
+
+    if (this->entry_mode_ & 0x01) {
+        next_y = this->x_counter_ >= x_high;
+        this->x_counter_ = next_y ? x_low : this->x_counter_ + 1;
+    } else {
+        next_y = this->x_counter_ <= x_low;
+        this->x_counter_ = next_y ? x_high : this->x_counter_ - 1;
+    }
+
+    if (!next_y) {
+        return;
+    }
+
+    if (this->entry_mode_ & 0x02) {
+        this->y_counter_ = (this->y_counter_ >= y_high) ? y_low : this->y_counter_ + 1;
+    } else {
+        this->y_counter_ = (this->y_counter_ <= y_low) ? y_high : this->y_counter_ - 1;
+    }
+}
+
+std::vector<uint8_t> SimulatedPanel::to_image_(const std::vector<uint8_t>& ram) const {
+    std::vector<uint8_t> image(ram.size());
+    for (uint16_t j = 0; j < this->height_; j++) {
+        std::copy_n(&ram[(this->height_ - 1 - j) * this->width_bound_], this->width_bound_,
+                    &image[j * this->width_bound_]);
+    }
+
+    return image;
+}
+
+}  // namespace epaper
@@ -0,0 +1,90 @@
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "project/backend.h"
+
+namespace epaper {
+
+constexpr size_t SpidevSpi::kSegmentSize;
+constexpr size_t SpidevSpi::kMaxSegments;
+
+SpidevSpi::~SpidevSpi() {
+    if (this->fd_ >= 0) {
+        close(this->fd_);
+    }
+}
+
+bool SpidevSpi::Setup(uint8_t channel, uint32_t speed) {
+    if (this->fd_ >= 0) {
+        close(this->fd_);
+    }
+
+    std::string device = "/dev/spidev0." + std::to_string(channel);
+    this->fd_          = open(device.c_str(), O_RDWR);
+    if (this->fd_ < 0) {
+        return false;
+    }
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    if (ioctl(this->fd_, SPI_IOC_WR_MODE, &mode) < 0 ||
+        ioctl(this->fd_, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(this->fd_, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+        return false;
+    }
+    this->speed_ = speed;
+
+    // the pi's boot config often raises bufsiz so whole frames fit into one message
+    std::ifstream bufsiz("/sys/module/spidev/parameters/bufsiz");
+    size_t        value = 0;
+    if (bufsiz >> value && value > 0) {
+        this->bufsiz_ = value;
+    }
+
+    return true;
+}
+
+void SpidevSpi::Write(const uint8_t* data, size_t len) {
+    if (this->fd_ < 0) {
+        return;
+    }
+
+    struct spi_ioc_transfer segments[kMaxSegments];
+
+    while (len > 0) {
+        // one message per bufsiz bytes, split into segments the controller driver can take
+        size_t message = std::min(len, this->bufsiz_);
+        size_t count   = 0;
+
+        std::memset(segments, 0, sizeof(segments));
+        while (message > 0 && count < kMaxSegments) {
+            size_t chunk = std::min(message, kSegmentSize);
+
+            segments[count].tx_buf        = reinterpret_cast<uintptr_t>(data);
+            segments[count].len           = chunk;
+            segments[count].speed_hz      = this->speed_;
+            segments[count].bits_per_word = 8;
+            count++;
+
+            data += chunk;
+            len -= chunk;
+            message -= chunk;
+        }
+
+        if (ioctl(this->fd_, SPI_IOC_MESSAGE(count), segments) < 0) {
+            std::wcout << "spi transfer failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+    }
+}
+
+}  // namespace epaper
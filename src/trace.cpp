@@ -0,0 +1,225 @@
+#include "project/trace.h"
+
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+namespace epaper {
+
+constexpr size_t  TraceRecorder::kFlushBytes;
+constexpr int64_t TraceReplayer::kBusyTimeoutMsec;
+
+namespace {
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool get_varint(const std::vector<uint8_t>& in, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (uint8_t shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        uint8_t byte = in[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}  // namespace
+
+TraceRecorder::TraceRecorder(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                             std::string path)
+    : TraceRecorder(std::move(gpio), std::move(spi), std::move(path), PanelPins()) {}
+
+TraceRecorder::TraceRecorder(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                             std::string path, PanelPins pins)
+    : gpio_(std::move(gpio)),
+      spi_(std::move(spi)),
+      path_(std::move(path)),
+      pins_(pins),
+      last_record_(Clock::now()) {}
+
+TraceRecorder::~TraceRecorder() { this->Flush(); }
+
+bool TraceRecorder::Setup(void) { return this->gpio_->Setup(); }
+
+void TraceRecorder::SetMode(uint8_t pin, Mode mode) { this->gpio_->SetMode(pin, mode); }
+
+void TraceRecorder::Write(uint8_t pin, uint8_t value) {
+    if (pin == this->pins_.dc) {
+        this->dc_ = value;
+    } else if (pin == this->pins_.rst) {
+        this->record_(TraceReset, &value, 1);
+    }
+
+    this->gpio_->Write(pin, value);
+}
+
+uint8_t TraceRecorder::Read(uint8_t pin) { return this->gpio_->Read(pin); }
+
+bool TraceRecorder::WaitForLow(uint8_t pin, int64_t msec) {
+    if (pin == this->pins_.busy) {
+        this->record_(TraceBusyWait, nullptr, 0);
+    }
+
+    return this->gpio_->WaitForLow(pin, msec);
+}
+
+bool TraceRecorder::Setup(uint8_t channel, uint32_t speed) {
+    uint8_t payload[5] = {channel, static_cast<uint8_t>(speed), static_cast<uint8_t>(speed >> 8),
+                          static_cast<uint8_t>(speed >> 16), static_cast<uint8_t>(speed >> 24)};
+    this->record_(TraceSpiSetup, payload, sizeof(payload));
+
+    return this->spi_->Setup(channel, speed);
+}
+
+void TraceRecorder::Write(const uint8_t* data, size_t len) {
+    this->record_(this->dc_ == 0 ? TraceCommand : TraceData, data, len);
+    this->spi_->Write(data, len);
+}
+
+bool TraceRecorder::Read(uint8_t* data, size_t len) { return this->spi_->Read(data, len); }
+
+bool TraceRecorder::Flush(void) {
+    // the file stays open so each flush is a single write
+    if (!this->file_.is_open() && !this->failed_) {
+        this->file_.open(this->path_, std::ios::binary | std::ios::trunc);
+        if (!this->file_) {
+            std::wcout << "unable to open trace file" << std::endl;
+            this->failed_ = true;
+        } else {
+            this->file_.write(kTraceMagic, sizeof(kTraceMagic));
+            this->file_.put(static_cast<char>(kTraceVersion));
+        }
+    }
+
+    if (this->failed_) {
+        this->records_.clear();
+        return false;
+    }
+
+    this->file_.write(reinterpret_cast<const char*>(this->records_.data()), this->records_.size());
+    this->file_.flush();
+    this->records_.clear();
+
+    return static_cast<bool>(this->file_);
+}
+
+void TraceRecorder::record_(TraceRecord type, const uint8_t* payload, size_t len) {
+    auto now   = Clock::now();
+    auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - this->last_record_);
+    this->last_record_ = now;
+
+    this->records_.push_back(type);
+    put_varint(this->records_, delta.count());
+    put_varint(this->records_, len);
+    this->records_.insert(this->records_.end(), payload, payload + len);
+
+    // a hang shows up as a busy wait that never ends, so everything before it has to be out
+    if (type == TraceBusyWait || type == TraceReset || this->records_.size() >= kFlushBytes) {
+        this->Flush();
+    }
+}
+
+TraceReplayer::TraceReplayer(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi)
+    : TraceReplayer(std::move(gpio), std::move(spi), PanelPins()) {}
+
+TraceReplayer::TraceReplayer(std::shared_ptr<GpioBackend> gpio, std::shared_ptr<SpiBackend> spi,
+                             PanelPins pins)
+    : gpio_(std::move(gpio)), spi_(std::move(spi)), pins_(pins) {}
+
+bool TraceReplayer::Replay(const std::string& path, bool paced) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::wcout << "unable to open trace file" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> trace((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+
+    size_t pos = sizeof(kTraceMagic) + 1;
+    if (trace.size() < pos || std::memcmp(trace.data(), kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+        trace[sizeof(kTraceMagic)] != kTraceVersion) {
+        std::wcout << "not a trace file" << std::endl;
+        return false;
+    }
+
+    this->gpio_->Setup();
+    this->gpio_->SetMode(this->pins_.rst, GpioBackend::kModeOutput);
+    this->gpio_->SetMode(this->pins_.dc, GpioBackend::kModeOutput);
+    this->gpio_->SetMode(this->pins_.cs, GpioBackend::kModeOutput);
+    this->gpio_->SetMode(this->pins_.busy, GpioBackend::kModeInput);
+    this->gpio_->Write(this->pins_.cs, 1);
+
+    auto next = std::chrono::steady_clock::now();
+
+    while (pos < trace.size()) {
+        uint8_t  type = trace[pos++];
+        uint64_t delta;
+        uint64_t len;
+        if (!get_varint(trace, pos, delta) || !get_varint(trace, pos, len) ||
+            len > trace.size() - pos) {
+            std::wcout << "trace is truncated" << std::endl;
+            return false;
+        }
+
+        const uint8_t* payload = trace.data() + pos;
+        pos += len;
+
+        next += std::chrono::microseconds(delta);
+        if (paced) {
+            std::this_thread::sleep_until(next);
+        }
+
+        switch (type) {
+            case TraceCommand:
+                this->send_(0, payload, len);
+                break;
+            case TraceData:
+                this->send_(1, payload, len);
+                break;
+            case TraceReset:
+                this->gpio_->Write(this->pins_.rst, len > 0 ? payload[0] : 1);
+                break;
+            case TraceBusyWait:
+                if (!this->gpio_->WaitForLow(this->pins_.busy, kBusyTimeoutMsec)) {
+                    std::wcout << "timed out waiting for display to become idle" << std::endl;
+                }
+                break;
+            case TraceSpiSetup:
+                if (len == 5) {
+                    uint32_t speed = payload[1] | (payload[2] << 8) | (payload[3] << 16) |
+                                     (static_cast<uint32_t>(payload[4]) << 24);
+                    this->spi_->Setup(payload[0], speed);
+                }
+                break;
+            default:
+                break;  // records from newer versions are skipped
+        }
+
+        // the panel may be slower than when recorded, keep pacing from where it is now
+        if (paced && std::chrono::steady_clock::now() > next) {
+            next = std::chrono::steady_clock::now();
+        }
+    }
+
+    return true;
+}
+
+void TraceReplayer::send_(uint8_t dc, const uint8_t* data, size_t len) {
+    this->gpio_->Write(this->pins_.dc, dc);
+    this->gpio_->Write(this->pins_.cs, 0);
+    this->spi_->Write(data, len);
+    this->gpio_->Write(this->pins_.cs, 1);
+}
+
+}  // namespace epaper
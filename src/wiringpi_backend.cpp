@@ -0,0 +1,108 @@
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+
+#include "project/epaper.h"
+
+namespace epaper {
+
+constexpr int64_t WiringPiGpio::kPollMsec;
+constexpr size_t  WiringPiSpi::kChunkSize;
+
+std::mutex              WiringPiGpio::edge_mutex_;
+std::condition_variable WiringPiGpio::edge_cv_;
+uint32_t                WiringPiGpio::edges_ = 0;
+
+// the default backends live here so builds without wiringpi (tests) only need to leave this
+// file out and construct the epaper with their own backends
+template <typename Panel>
+BasicEpaper<Panel>::BasicEpaper(PanelConfig config)
+    : BasicEpaper(std::make_shared<WiringPiGpio>(), std::make_shared<WiringPiSpi>(),
+                  std::move(config)) {}
+
+template <typename Panel>
+BasicEpaper<Panel>& BasicPanelGroup<Panel>::Add(PanelConfig config) {
+    return this->Add(std::make_shared<WiringPiGpio>(), std::make_shared<WiringPiSpi>(),
+                     std::move(config));
+}
+
+template BasicEpaper<Panel213>::BasicEpaper(PanelConfig);
+template BasicEpaper<Panel290>::BasicEpaper(PanelConfig);
+template BasicEpaper<Panel420>::BasicEpaper(PanelConfig);
+
+template BasicEpaper<Panel213>& BasicPanelGroup<Panel213>::Add(PanelConfig);
+template BasicEpaper<Panel290>& BasicPanelGroup<Panel290>::Add(PanelConfig);
+template BasicEpaper<Panel420>& BasicPanelGroup<Panel420>::Add(PanelConfig);
+
+void WiringPiGpio::edge_isr_(void) {
+    {
+        std::lock_guard<std::mutex> lock(edge_mutex_);
+        edges_++;
+    }
+    edge_cv_.notify_all();
+}
+
+bool WiringPiGpio::Setup(void) { return wiringPiSetupGpio() >= 0; }
+
+void WiringPiGpio::SetMode(uint8_t pin, Mode mode) {
+    // macros come from wiringpi library
+    if (mode == kModeInput) {
+        pinMode(pin, INPUT);
+        pullUpDnControl(pin, PUD_UP);
+
+        if (wiringPiISR(pin, INT_EDGE_FALLING, &WiringPiGpio::edge_isr_) >= 0) {
+            this->interrupt_pins_.insert(pin);
+        } else {
+            std::wcout << "failed to set up interrupt on pin " << static_cast<int>(pin)
+                       << ", polling instead" << std::endl;
+        }
+    } else {
+        pinMode(pin, OUTPUT);
+    }
+}
+
+void WiringPiGpio::Write(uint8_t pin, uint8_t value) { digitalWrite(pin, value); }
+
+uint8_t WiringPiGpio::Read(uint8_t pin) { return digitalRead(pin); }
+
+bool WiringPiGpio::WaitForLow(uint8_t pin, int64_t msec) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+
+    if (this->interrupt_pins_.count(pin) == 0) {
+        while (digitalRead(pin) == HIGH) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollMsec));
+        }
+        return true;
+    }
+
+    // the interrupt thread needs the lock to count an edge, so an edge between reading the pin
+    // and waiting can't be missed
+    std::unique_lock<std::mutex> lock(edge_mutex_);
+    while (digitalRead(pin) == HIGH) {
+        uint32_t edges = edges_;
+        if (!edge_cv_.wait_until(lock, deadline, [edges] { return edges_ != edges; })) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WiringPiSpi::Setup(uint8_t channel, uint32_t speed) {
+    this->channel_ = channel;
+    return wiringPiSPISetup(channel, speed) >= 0;
+}
+
+void WiringPiSpi::Write(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        size_t chunk = std::min(len, kChunkSize);
+        std::memcpy(this->buffer_, data, chunk);
+        wiringPiSPIDataRW(this->channel_, this->buffer_, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+}  // namespace epaper
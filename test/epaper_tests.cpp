@@ -1,13 +1,1055 @@
 #define CATCH_CONFIG_MAIN
 
 #include <stdio.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "../include/project/bitops.h"
 #include "../include/project/epaper.h"
+#include "../include/project/simulated_panel.h"
+#include "../include/project/trace.h"
 #include "../include/third-party/catch.hpp"
 
 using namespace epaper;
 
+namespace {
+
+// every operator new in the test binary, to check the steady state frame loop stays off the heap
+std::atomic<size_t> heap_allocations(0);
+
+}  // namespace
+
+void* operator new(size_t size) {
+    heap_allocations++;
+    if (void* block = std::malloc(size ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    heap_allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+void operator delete[](void* block, size_t) noexcept { std::free(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { std::free(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { std::free(block); }
+
+namespace {
+
+// busy never holds up the tests
+const SimulatedPanel::Timing kNoDelay = {0, 0, 0, 0};
+
+std::vector<uint8_t> to_vector(Bitmap& image) {
+    return std::vector<uint8_t>(image.Raw(), image.Raw() + Epaper::kFrameSize);
+}
+
+bool pixel(const Bitmap& image, size_t row, size_t column) {
+    return (image(row, column / 8) >> (7 - column % 8)) & 1;
+}
+
+bool render_pixel(bool dst, bool src, Renderer::RenderAction action) {
+    switch (action) {
+        case Renderer::kRenderActionAnd:
+            return dst && src;
+        case Renderer::kRenderActionOr:
+            return dst || src;
+        case Renderer::kRenderActionXor:
+            return dst != src;
+        default:
+            return src;
+    }
+}
+
+// text rendered the way RenderText did before it laid the glyphs out upright, each pixel goes
+// straight to its place in the turned image
+Bitmap reference_text(FT_Face face, const std::wstring& text) {
+    FT_Bitmap* bitmap         = &face->glyph->bitmap;
+    uint16_t   target_width   = 0;
+    uint16_t   target_height  = 0;
+    uint16_t   target_advance = 0;
+    for (auto const& character : text) {
+        FT_Load_Char(face, character, FT_LOAD_NO_BITMAP);
+        target_width   = std::max<uint16_t>(target_width, bitmap->rows);
+        target_height  = std::max<uint16_t>(target_height, bitmap->width);
+        target_advance = std::max<uint16_t>(target_advance, face->glyph->advance.x / 64);
+    }
+
+    auto image = Bitmap(std::max(target_height, target_advance) * text.size(), target_width);
+    image.ClearBlack();
+
+    size_t row_bits = image.width_bound() * 8;
+    size_t k        = 0;
+    for (auto const& character : text) {
+        FT_Load_Char(face, character, FT_LOAD_RENDER);
+        if (character == L' ') {
+            k += row_bits * (std::min(target_advance, target_height) / 2);
+            continue;
+        }
+
+        uint16_t start_padding = target_width - bitmap->rows;
+        if (character == L':' || character == L'-') {
+            start_padding /= 2;
+        } else if (character == L'°') {
+            start_padding = 0;
+        }
+
+        for (uint16_t j = 0; j < bitmap->width; j++) {
+            k += start_padding;
+            for (uint16_t i = 0; i < bitmap->rows; i++, k++) {
+                if (bitmap->buffer[bitmap->width * i + j] != 0) {
+                    image[k / 8] |= 0x80 >> (k % 8);
+                }
+            }
+            k += row_bits - bitmap->rows - start_padding;
+        }
+
+        k += row_bits * std::max<FT_Pos>(face->glyph->advance.x / 64 - bitmap->width, 1);
+    }
+
+    image.Invert();
+    return image;
+}
+
+// gpio and spi lines wired to several panels at once, each panel only reacts to its own pins and
+// to the bytes clocked in while it is selected
+class SharedWires : public GpioBackend, public SpiBackend {
+   public:
+    explicit SharedWires(std::vector<std::shared_ptr<SimulatedPanel>> panels)
+        : panels_(std::move(panels)) {}
+
+    bool Setup(void) override { return true; }
+    void SetMode(uint8_t pin, Mode mode) override {
+        (void)pin;
+        (void)mode;
+    }
+
+    void Write(uint8_t pin, uint8_t value) override {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        for (auto& panel : this->panels_) {
+            panel->Write(pin, value);
+        }
+    }
+
+    uint8_t Read(uint8_t pin) override {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        uint8_t                     level = 0;
+        for (auto& panel : this->panels_) {
+            level |= panel->Read(pin);
+        }
+        return level;
+    }
+
+    // only the panel with pin as its busy line waits
+    bool WaitForLow(uint8_t pin, int64_t msec) override {
+        bool low = true;
+        for (auto& panel : this->panels_) {
+            low = panel->WaitForLow(pin, msec) && low;
+        }
+        return low;
+    }
+
+    bool Setup(uint8_t channel, uint32_t speed) override {
+        (void)channel;
+        (void)speed;
+        return true;
+    }
+
+    // the bytes take a while to clock out, long enough for other threads to get to the pins
+    void Write(const uint8_t* data, size_t len) override {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            for (auto& panel : this->panels_) {
+                panel->Write(data, len);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(len + 20));
+    }
+
+    bool Read(uint8_t* data, size_t len) override {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        for (auto& panel : this->panels_) {
+            if (panel->Read(data, len)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    std::vector<std::shared_ptr<SimulatedPanel>> panels_;
+    std::mutex                                   mutex_;
+};
+
+}  // namespace
+
 TEST_CASE("sanity", "[sanity]") {
     REQUIRE(1 == 1);
     REQUIRE(0x05 == 0x05);
 }
+
+TEST_CASE("simulated panel shows displayed image", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    for (uint16_t i = 0; i < Epaper::kFrameSize; i++) {
+        image[i] = i & 0xFF;
+    }
+
+    paper.DisplayImage(image.Raw());
+
+    REQUIRE(panel->counters().full_refreshes == 1);
+    REQUIRE(panel->Displayed() == to_vector(image));
+
+    SECTION("unchanged image is not sent again") {
+        panel->ResetCounters();
+        paper.DisplayImage(image.Raw());
+
+        REQUIRE(panel->counters().full_refreshes == 0);
+        REQUIRE(panel->counters().transfers == 0);
+    }
+
+    SECTION("only changed rows are sent") {
+        image(100, 3) = 0x00;
+        image(104, 5) = 0x00;
+
+        panel->ResetCounters();
+        paper.DisplayImage(image.Raw());
+
+        REQUIRE(panel->counters().full_refreshes == 1);
+        REQUIRE(panel->counters().data_bytes < Epaper::kFrameSize / 10);
+        REQUIRE(panel->Displayed() == to_vector(image));
+    }
+
+    SECTION("window only sends its bytes") {
+        auto cleared = Bitmap(Epaper::kHeight, Epaper::kWidth);
+
+        panel->ResetCounters();
+        paper.DisplayWindow(cleared.Raw(), {10, 16, 4, 16});
+
+        // new ram and then old ram with the window's 8 bytes plus the window setup
+        REQUIRE(panel->counters().data_bytes < 2 * (4 * 2 + 16));
+        REQUIRE(panel->Displayed()[10 * 16 + 2] == 0xFF);
+        REQUIRE(panel->Displayed()[13 * 16 + 3] == 0xFF);
+        REQUIRE(panel->Displayed()[14 * 16 + 2] == image(14, 2));
+        REQUIRE(panel->Displayed()[10 * 16 + 4] == image(10, 4));
+    }
+}
+
+TEST_CASE("bitmap storage", "[bitmap]") {
+    auto glyph = Bitmap(20, 12);
+    auto frame = Bitmap(Epaper::kHeight, Epaper::kWidth);
+
+    REQUIRE(glyph.size() == 20 * 2);
+    REQUIRE(frame.size() == Epaper::kFrameSize);
+    REQUIRE(reinterpret_cast<uintptr_t>(glyph.Raw()) % 64 == 0);
+    REQUIRE(reinterpret_cast<uintptr_t>(frame.Raw()) % 64 == 0);
+
+    glyph(3, 1) = 0x5A;
+    frame(7, 2) = 0xA5;
+    REQUIRE(glyph[3 * 2 + 1] == 0x5A);
+    REQUIRE(frame[7 * frame.width_bound() + 2] == 0xA5);
+
+    SECTION("moves keep the pixels") {
+        auto moved_glyph = std::move(glyph);
+        auto moved_frame = std::move(frame);
+
+        REQUIRE(moved_glyph(3, 1) == 0x5A);
+        REQUIRE(moved_frame(7, 2) == 0xA5);
+        REQUIRE(reinterpret_cast<uintptr_t>(moved_glyph.Raw()) % 64 == 0);
+        REQUIRE(glyph.size() == 0);
+
+        moved_glyph = Bitmap(4, 8);
+        REQUIRE(moved_glyph.size() == 4);
+        REQUIRE(moved_glyph(3, 0) == 0xFF);
+    }
+}
+
+TEST_CASE("frame arena", "[bitmap]") {
+    FrameArena arena(1024);
+
+    auto first  = Bitmap(20, 128, arena);
+    auto second = Bitmap(20, 128, arena);
+
+    // both start on a multiple of 64 bytes
+    REQUIRE(arena.used() >= 2 * 320);
+    REQUIRE(arena.used() < 2 * 320 + 2 * 64);
+    REQUIRE(reinterpret_cast<uintptr_t>(second.Raw()) % 64 == 0);
+    REQUIRE(second(19, 15) == 0xFF);
+
+    SECTION("bitmaps that don't fit go to the heap") {
+        auto large = Bitmap(64, 128, arena);
+        large(63, 15) = 0x00;
+
+        REQUIRE(arena.used() <= 1024);
+        REQUIRE(large(63, 15) == 0x00);
+
+        arena.Reset();
+        REQUIRE(arena.used() == 0);
+        REQUIRE(arena.capacity() >= 2 * 320 + 1024);
+    }
+
+    SECTION("small bitmaps stay inline") {
+        size_t used = arena.used();
+        auto   glyph = Bitmap(8, 16, arena);
+
+        REQUIRE(arena.used() == used);
+    }
+}
+
+TEST_CASE("text renders from the frame arena without the heap", "[bitmap][text]") {
+    TextRenderer renderer(24, TextRenderer::Fonts::kDroidSans);
+    FrameArena   arena(64);
+    auto         image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    std::wstring text  = L"12:34 -5° sunny";
+
+    // the first frame sizes the scratch and the arena, later ones only reuse them
+    auto frame = [&]() {
+        auto rendered = renderer.RenderText(text, arena);
+        renderer.DrawOnImage(image, rendered, 4, 3);
+        return rendered.size();
+    };
+
+    size_t size = frame();
+    arena.Reset();
+    size_t capacity = arena.capacity();
+    REQUIRE(size > 256);  // too big to be kept inline
+
+    for (int n = 0; n < 3; n++) {
+        size_t before   = heap_allocations;
+        size_t rendered = frame();
+        size_t after    = heap_allocations;
+
+        REQUIRE(rendered == size);
+        REQUIRE(after == before);
+        REQUIRE(arena.used() >= size);
+        arena.Reset();
+        REQUIRE(arena.capacity() == capacity);
+    }
+}
+
+TEST_CASE("rendered text matches the pixel by pixel reference", "[bitmap][text]") {
+    FT_Library library;
+    REQUIRE(FT_Init_FreeType(&library) == 0);
+
+    Renderer drawer;
+
+    for (const char* font : {TextRenderer::Fonts::kDroidSans, TextRenderer::Fonts::kWeather}) {
+        for (uint16_t size : {17, 32}) {
+            TextRenderer renderer(size, font);
+            FrameArena   arena(4096);
+
+            FT_Face face;
+            REQUIRE(FT_New_Face(library, font, 0, &face) == 0);
+            FT_Set_Pixel_Sizes(face, 0, size);
+
+            for (std::wstring text : {L"12:34", L"-7° light rain", L"\uf00d\uf019"}) {
+                INFO("size " << size << " text " << text.size() << " characters of " << font);
+
+                auto reference  = reference_text(face, text);
+                auto rendered   = renderer.RenderText(text);
+                auto from_arena = renderer.RenderText(text, arena);
+                arena.Reset();
+
+                // not a blank bitmap that would match anything
+                REQUIRE(std::count(reference.Raw(), reference.Raw() + reference.size(), 0xFF) <
+                        static_cast<long>(reference.size()));
+
+                REQUIRE(rendered.height() == reference.height());
+                REQUIRE(rendered.width() == reference.width());
+                REQUIRE(std::equal(rendered.Raw(), rendered.Raw() + rendered.size(),
+                                   reference.Raw()));
+                REQUIRE(std::equal(from_arena.Raw(), from_arena.Raw() + from_arena.size(),
+                                   reference.Raw()));
+
+                for (auto rotation : {Bitmap::kRotation0, Bitmap::kRotation90,
+                                      Bitmap::kRotation180, Bitmap::kRotation270}) {
+                    auto turned = rendered.Rotated(rotation);
+
+                    for (uint16_t start_width : {0, 3, 8, 13}) {
+                        auto frame = Bitmap(Epaper::kHeight, Epaper::kWidth);
+                        drawer.DrawOnImage(frame, turned, 5, start_width);
+
+                        // the reference turns and draws one pixel at a time
+                        auto expected = Bitmap(Epaper::kHeight, Epaper::kWidth);
+                        for (uint16_t j = 0; j < reference.height(); j++) {
+                            for (uint16_t i = 0; i < reference.width(); i++) {
+                                uint16_t y = j;
+                                uint16_t x = i;
+                                if (rotation == Bitmap::kRotation90) {
+                                    y = i;
+                                    x = reference.height() - 1 - j;
+                                } else if (rotation == Bitmap::kRotation180) {
+                                    y = reference.height() - 1 - j;
+                                    x = reference.width() - 1 - i;
+                                } else if (rotation == Bitmap::kRotation270) {
+                                    y = reference.width() - 1 - i;
+                                    x = j;
+                                }
+
+                                size_t row    = y + 5;
+                                size_t column = x + start_width;
+                                if (row < Epaper::kHeight && column < Epaper::kWidth &&
+                                    !pixel(reference, j, i)) {
+                                    expected(row, column / 8) &= ~(0x80 >> (column % 8));
+                                }
+                            }
+                        }
+
+                        INFO("rotation " << rotation << " at " << start_width);
+                        REQUIRE(to_vector(frame) == to_vector(expected));
+                    }
+                }
+            }
+
+            FT_Done_Face(face);
+        }
+    }
+
+    FT_Done_FreeType(library);
+}
+
+TEST_CASE("bit kernels match the scalar versions", "[bitmap]") {
+    std::vector<uint8_t> a(160), b(160);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = (i * 37 + 11) & 0xFF;
+        b[i] = (i * 91 + 5) & 0xFF;
+    }
+
+    // odd offsets and lengths leave partial vectors at both ends
+    for (size_t offset : {0, 1, 3}) {
+        for (size_t len : {0, 7, 16, 33, 64, 129}) {
+            auto kernel = a;
+            auto scalar = a;
+
+            bits::Invert(&kernel[offset], len);
+            bits::scalar::Invert(&scalar[offset], len);
+            bits::And(&kernel[offset], &b[1], len);
+            bits::scalar::And(&scalar[offset], &b[1], len);
+            bits::Or(&kernel[offset], &b[2], len);
+            bits::scalar::Or(&scalar[offset], &b[2], len);
+            bits::Xor(&kernel[offset], &b[0], len);
+            bits::scalar::Xor(&scalar[offset], &b[0], len);
+            REQUIRE(kernel == scalar);
+
+            bits::Fill(&kernel[offset], len, 0x5A);
+            bits::scalar::Fill(&scalar[offset], len, 0x5A);
+            REQUIRE(kernel == scalar);
+            REQUIRE(bits::Equal(&kernel[offset], &scalar[offset], len));
+
+            if (len > 0) {
+                kernel[offset + len - 1] ^= 0x10;
+                REQUIRE(!bits::Equal(&kernel[offset], &scalar[offset], len));
+                REQUIRE(bits::Equal(&kernel[offset], &scalar[offset], len - 1));
+            }
+        }
+    }
+}
+
+TEST_CASE("draw on image clips at the edges", "[bitmap]") {
+    auto target = Bitmap(16, 32);
+    auto sprite = Bitmap(8, 24);
+    sprite.ClearBlack();
+
+    Renderer renderer;
+    renderer.DrawOnImage(target, sprite, 12, 16);
+
+    REQUIRE(target(11, 2) == 0xFF);
+    REQUIRE(target(12, 1) == 0xFF);
+    REQUIRE(target(12, 2) == 0x00);
+    REQUIRE(target(15, 3) == 0x00);
+
+    SECTION("xor flips the covered bytes back") {
+        sprite.ClearWhite();
+        renderer.DrawOnImage(target, sprite, 12, 16, Renderer::kRenderActionXor);
+
+        REQUIRE(target(12, 2) == 0xFF);
+        REQUIRE(target(15, 3) == 0xFF);
+        REQUIRE(target(11, 2) == 0xFF);
+    }
+}
+
+TEST_CASE("draw on image places pixels exactly", "[bitmap]") {
+    Renderer renderer;
+
+    for (uint16_t sprite_width : {5, 13, 100}) {
+        auto sprite = Bitmap(6, sprite_width);
+        for (size_t i = 0; i < sprite.size(); i++) {
+            sprite[i] = (i * 29 + 3) & 0xFF;
+        }
+
+        for (uint16_t start_width : {0, 3, 8, 11, 30, 117}) {
+            for (auto action : {Renderer::kRenderActionReplace, Renderer::kRenderActionAnd,
+                                Renderer::kRenderActionOr, Renderer::kRenderActionXor}) {
+                auto target = Bitmap(12, Epaper::kWidth);
+                for (size_t i = 0; i < target.size(); i++) {
+                    target[i] = (i * 53 + 7) & 0xFF;
+                }
+                auto before = Bitmap(12, Epaper::kWidth);
+                std::copy_n(target.Raw(), target.size(), before.Raw());
+
+                renderer.DrawOnImage(target, sprite, 4, start_width, action);
+
+                // compared pixel by pixel against the sprite, everything outside is untouched
+                bool matches = true;
+                for (uint16_t j = 0; j < target.height(); j++) {
+                    for (uint16_t i = 0; i < target.width(); i++) {
+                        bool expected = pixel(before, j, i);
+                        if (j >= 4 && j < 10 && i >= start_width &&
+                            i < start_width + sprite_width) {
+                            bool drawn = pixel(sprite, j - 4, i - start_width);
+                            expected   = render_pixel(expected, drawn, action);
+                        }
+                        matches = matches && pixel(target, j, i) == expected;
+                    }
+                }
+
+                INFO("width " << sprite_width << " at " << start_width << " action " << action);
+                REQUIRE(matches);
+            }
+        }
+    }
+}
+
+TEST_CASE("bitmap rotation", "[bitmap]") {
+    for (auto size : {std::make_pair(8, 16), std::make_pair(13, 21), std::make_pair(1, 9),
+                      std::make_pair(30, 67)}) {
+        auto image = Bitmap(size.first, size.second);
+        for (size_t i = 0; i < image.size(); i++) {
+            image[i] = (i * 41 + 9) & 0xFF;
+        }
+
+        uint16_t height = image.height();
+        uint16_t width  = image.width();
+
+        auto transposed = image.Transposed();
+        auto right      = image.Rotated(Bitmap::kRotation90);
+        auto flipped    = image.Rotated(Bitmap::kRotation180);
+        auto left       = image.Rotated(Bitmap::kRotation270);
+
+        REQUIRE(right.height() == width);
+        REQUIRE(right.width() == height);
+        REQUIRE(flipped.height() == height);
+
+        bool matches = true;
+        for (uint16_t j = 0; j < height; j++) {
+            for (uint16_t i = 0; i < width; i++) {
+                bool value = pixel(image, j, i);
+                matches    = matches && pixel(transposed, i, j) == value;
+                matches    = matches && pixel(right, i, height - 1 - j) == value;
+                matches    = matches && pixel(flipped, height - 1 - j, width - 1 - i) == value;
+                matches    = matches && pixel(left, width - 1 - i, j) == value;
+            }
+        }
+
+        INFO("size " << height << "x" << width);
+        REQUIRE(matches);
+    }
+}
+
+TEST_CASE("panel descriptors size the driver", "[epaper][simulated]") {
+    using Paper = BasicEpaper<Panel420>;
+
+    auto  panel = std::make_shared<SimulatedPanel>(Paper::kHeight, Paper::kWidth, kNoDelay);
+    Paper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+
+    REQUIRE(Paper::kFrameSize == 300 * 50);
+
+    std::vector<uint8_t> image(Paper::kFrameSize);
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = (i * 7) & 0xFF;
+    }
+
+    paper.DisplayImage(image.data());
+
+    // the otp waveform is used so nothing is uploaded
+    REQUIRE(panel->counters().lut_uploads == 0);
+    REQUIRE(panel->counters().full_refreshes == 1);
+    REQUIRE(panel->Displayed() == image);
+
+    SECTION("partial updates use the panel's own registers") {
+        paper.InitPartialUpdate();
+        image[1234] ^= 0xFF;
+        paper.DisplayImage(image.data());
+
+        REQUIRE(panel->counters().lut_uploads == 0);
+        REQUIRE(panel->counters().partial_refreshes == 1);
+        REQUIRE(panel->Displayed() == image);
+    }
+}
+
+TEST_CASE("simulated panel fills", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    image.ClearBlack();
+    paper.DisplayImage(image.Raw());
+
+    SECTION("clear is filled by the controller") {
+        panel->ResetCounters();
+        paper.ClearDisplay();
+
+        REQUIRE(panel->counters().data_bytes < 32);
+        REQUIRE(panel->Displayed() == std::vector<uint8_t>(Epaper::kFrameSize, 0xFF));
+    }
+
+    SECTION("clear covers the whole frame after a window was written") {
+        image(20, 3) = 0x0F;
+        paper.DisplayWindow(image.Raw(), {16, 16, 8, 16});
+        paper.ClearDisplay();
+
+        REQUIRE(panel->Displayed() == std::vector<uint8_t>(Epaper::kFrameSize, 0xFF));
+
+        // old ram was cleared everywhere too, a partial update only drives the new pixels
+        paper.InitPartialUpdate();
+        image.ClearWhite();
+        image(100, 5) = 0x00;
+        panel->ResetCounters();
+        paper.DisplayImage(image.Raw());
+
+        REQUIRE(panel->Displayed() == to_vector(image));
+        REQUIRE(panel->counters().driven_pixels == 8);
+    }
+
+    SECTION("oversized windows are clipped to the panel") {
+        paper.FillRegion({10, 0, 65535, 8}, 0xAA);
+        paper.FillRegion({0, 8, 4, 65535}, 0x55);
+        for (uint16_t j = 10; j < Epaper::kHeight; j++) {
+            image(j, 0) = 0xAA;
+        }
+        for (uint16_t j = 0; j < 4; j++) {
+            std::fill_n(&image(j, 1), image.width_bound() - 1, 0x55);
+        }
+        REQUIRE(panel->Displayed() == to_vector(image));
+
+        image(200, 3) = 0x3C;
+        paper.DisplayWindow(image.Raw(), {150, 16, 65535, 65535});
+        REQUIRE(panel->Displayed() == to_vector(image));
+    }
+
+    SECTION("region is filled over spi") {
+        paper.FillRegion({8, 8, 2, 16}, 0xAA);
+        image(8, 1) = image(8, 2) = image(9, 1) = image(9, 2) = 0xAA;
+
+        REQUIRE(panel->Displayed() == to_vector(image));
+
+        // the shadow knows about the fill
+        panel->ResetCounters();
+        paper.DisplayImage(image.Raw());
+        REQUIRE(panel->counters().transfers == 0);
+    }
+}
+
+TEST_CASE("simulated panel partial update", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    paper.DisplayBaseImage(image.Raw());
+    paper.InitPartialUpdate();
+
+    for (uint16_t i = 0; i < Epaper::kFrameSize; i++) {
+        image[i] = (i * 7) & 0xFF;
+    }
+    paper.DisplayPartial(image.Raw());
+
+    REQUIRE(panel->counters().full_refreshes == 1);
+    REQUIRE(panel->counters().partial_refreshes == 1);
+    REQUIRE(panel->Displayed() == to_vector(image));
+
+    SECTION("only the flipped pixels are driven") {
+        image(30, 4) ^= 0x81;
+        image(200, 9) ^= 0x10;
+
+        panel->ResetCounters();
+        paper.DisplayImage(image.Raw());
+        image(31, 4) ^= 0x01;
+        paper.DisplayImage(image.Raw());
+
+        REQUIRE(panel->counters().partial_refreshes == 2);
+        REQUIRE(panel->counters().driven_pixels == 4);
+        REQUIRE(panel->OldImage() == to_vector(image));
+        REQUIRE(panel->Displayed() == to_vector(image));
+    }
+}
+
+TEST_CASE("simulated panel wakes from deep sleep", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    image.ClearBlack();
+    paper.DisplayImage(image.Raw());
+    paper.DeepSleep();
+
+    REQUIRE(panel->sleeping());
+
+    image(20, 1) = 0xFF;
+    panel->ResetCounters();
+    paper.DisplayImage(image.Raw());
+
+    // the ram survived so only the changed row is sent after the registers are restored
+    REQUIRE_FALSE(panel->sleeping());
+    REQUIRE(panel->counters().resets == 1);
+    REQUIRE(panel->counters().data_bytes < 200);
+    REQUIRE(panel->Displayed() == to_vector(image));
+}
+
+TEST_CASE("async display runs operations in order", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    image.ClearBlack();
+
+    AsyncDisplay display(paper);
+    display.Run([](Epaper& p) { p.InitFullUpdate(); });
+    auto done = display.DisplayImage(image.Raw());
+    image.ClearWhite();  // the queued frame is a copy
+    done.wait();
+
+    REQUIRE(panel->Displayed() == std::vector<uint8_t>(Epaper::kFrameSize, 0x00));
+}
+
+TEST_CASE("panel group refreshes displays together", "[epaper][simulated]") {
+    SimulatedPanel::Timing timing = kNoDelay;
+    timing.full_refresh_msec      = 300;
+
+    PanelPins second_pins;
+    second_pins.rst  = 5;
+    second_pins.dc   = 6;
+    second_pins.cs   = 7;
+    second_pins.busy = 13;
+
+    auto first  = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, timing);
+    auto second = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, timing,
+                                                   second_pins);
+
+    PanelConfig second_config;
+    second_config.pins        = second_pins;
+    second_config.spi_channel = 1;
+
+    PanelGroup group;
+    group.Add(first, first, PanelConfig());
+    group.Add(second, second, second_config);
+    REQUIRE(group.size() == 2);
+
+    group.SetUpIos();
+    group.InitFullUpdate();
+
+    auto black = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    auto white = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    black.ClearBlack();
+    white.ClearWhite();
+
+    auto start = std::chrono::steady_clock::now();
+    group.DisplayImages({black.Raw(), white.Raw()});
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(first->Displayed() == to_vector(black));
+    REQUIRE(second->Displayed() == to_vector(white));
+    REQUIRE(first->counters().full_refreshes == 1);
+    REQUIRE(second->counters().full_refreshes == 1);
+
+    // the refreshes overlap rather than running back to back
+    REQUIRE(elapsed < std::chrono::milliseconds(2 * timing.full_refresh_msec));
+}
+
+TEST_CASE("panel group shares the dc line", "[epaper][simulated]") {
+    // only chip select tells the panels apart
+    PanelPins second_pins;
+    second_pins.rst  = 5;
+    second_pins.cs   = 7;
+    second_pins.busy = 13;
+
+    // different busy periods keep the workers out of step so their transfers interleave
+    SimulatedPanel::Timing first_timing  = {1, 2, 1, 1};
+    SimulatedPanel::Timing second_timing = {3, 5, 2, 2};
+
+    auto first  = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, first_timing);
+    auto second = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth,
+                                                   second_timing, second_pins);
+    auto wires  = std::make_shared<SharedWires>(
+        std::vector<std::shared_ptr<SimulatedPanel>>{first, second});
+
+    PanelConfig second_config;
+    second_config.pins = second_pins;
+
+    PanelGroup group;
+    group.Add(wires, wires, PanelConfig());
+    group.Add(wires, wires, second_config);
+
+    group.SetUpIos();
+    group.InitFullUpdate();
+
+    auto one = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    auto two = Bitmap(Epaper::kHeight, Epaper::kWidth);
+
+    for (int frame = 0; frame < 8; frame++) {
+        for (size_t i = 0; i < one.size(); i++) {
+            one[i] = (i * 13 + frame) & 0xFF;
+            two[i] = (i * 71 + frame * 3) & 0xFF;
+        }
+
+        group.DisplayImages({one.Raw(), two.Raw()});
+
+        REQUIRE(first->Displayed() == to_vector(one));
+        REQUIRE(second->Displayed() == to_vector(two));
+    }
+}
+
+TEST_CASE("waveform follows the panel temperature", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.SetLuts(LutRegistry::Experimental());
+
+    auto waveform = [](LutKind kind, int8_t celsius) {
+        const uint8_t* lut = LutRegistry::Experimental().Find(kind, celsius)->data;
+        return std::vector<uint8_t>(lut, lut + 70);
+    };
+
+    // only the vendor's waveforms are picked without opting in, they cover every temperature
+    const LutRegistry& vendor = LutRegistry::Default();
+    REQUIRE(vendor.Find(LutKindFull, -20)->data == vendor.Find(LutKindFull, 40)->data);
+    REQUIRE(vendor.Find(LutKindPartial, -20)->data == vendor.Find(LutKindPartial, 40)->data);
+    REQUIRE(vendor.Find(LutKindFast, 20)->data == vendor.Find(LutKindFull, 20)->data);
+
+    panel->SetTemperature(5);
+    paper.InitFullUpdate();
+    REQUIRE(panel->waveform() == waveform(LutKindFull, 5));
+    REQUIRE(waveform(LutKindFull, 5) != waveform(LutKindFull, 20));
+
+    SECTION("unchanged range is not uploaded again") {
+        panel->ResetCounters();
+        panel->SetTemperature(8);
+        REQUIRE(paper.UpdateTemperature() == 8);
+        REQUIRE(panel->counters().lut_uploads == 0);
+
+        panel->SetTemperature(22);
+        REQUIRE(paper.UpdateTemperature() == 22);
+        REQUIRE(panel->counters().lut_uploads == 1);
+        REQUIRE(panel->waveform() == waveform(LutKindFull, 22));
+    }
+
+    SECTION("forced temperature") {
+        paper.ForceTemperature(25);
+        paper.UpdateTemperature();
+        paper.InitPartialUpdate();
+        REQUIRE(panel->waveform() == waveform(LutKindPartial, 25));
+
+        paper.InitFastUpdate();
+        REQUIRE(panel->waveform() == waveform(LutKindFast, 25));
+    }
+}
+
+TEST_CASE("refresh policy clears ghosting with full refreshes", "[epaper][simulated]") {
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+
+    RefreshPolicy::Budget budget;
+    budget.partials        = 3;
+    budget.flips_per_pixel = 1;
+    budget.quiet_hour      = -1;
+    RefreshPolicy policy(paper, budget);
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    policy.Display(image.Raw());
+    REQUIRE(panel->counters().full_refreshes == 1);
+
+    // the same image is not shown again
+    policy.Display(image.Raw());
+    REQUIRE(panel->counters().partial_refreshes == 0);
+
+    SECTION("flips in one region") {
+        // flipping the first 16x16 region once uses up its budget, the second time is over it
+        for (uint16_t j = 0; j < 16; j++) {
+            image(j, 0) = image(j, 1) = 0x00;
+        }
+        paper.ResetStats();
+        policy.Display(image.Raw());
+        REQUIRE(panel->counters().partial_refreshes == 1);
+        REQUIRE(policy.MaxRegionFlips() == 256);
+
+        // only the changed 16 rows of 2 bytes go to the new and then the old ram
+        REQUIRE(paper.stats().command_bytes[0x24] == 16 * 2);
+        REQUIRE(paper.stats().command_bytes[0x26] == 16 * 2);
+        REQUIRE(paper.stats().data_bytes < 2 * 16 * 2 + 32);
+
+        image.ClearWhite();
+        policy.Display(image.Raw());
+        REQUIRE(panel->counters().partial_refreshes == 1);
+        REQUIRE(panel->counters().full_refreshes == 2);
+        REQUIRE(policy.MaxRegionFlips() == 0);
+        REQUIRE(panel->Displayed() == to_vector(image));
+    }
+
+    SECTION("number of partial updates") {
+        for (uint16_t n = 0; n < 4; n++) {
+            image[n * 100] = 0x7F;
+            policy.Display(image.Raw());
+        }
+        REQUIRE(panel->counters().partial_refreshes == 3);
+        REQUIRE(panel->counters().full_refreshes == 2);
+        REQUIRE(policy.partials() == 0);
+    }
+
+    SECTION("quiet hour") {
+        std::tm quiet = {};
+        quiet.tm_year = 120;
+        quiet.tm_mday = 1;
+        quiet.tm_hour = 3;
+        auto at_three = std::chrono::system_clock::from_time_t(std::mktime(&quiet));
+
+        RefreshPolicy::Budget nightly = budget;
+        nightly.quiet_hour            = 3;
+        RefreshPolicy night(paper, nightly);
+        night.Display(image.Raw(), at_three - std::chrono::hours(2));
+        REQUIRE(panel->counters().full_refreshes == 2);
+
+        image[0] = 0x7F;
+        night.Display(image.Raw(), at_three);
+        REQUIRE(panel->counters().full_refreshes == 3);
+
+        // only once within the quiet hour
+        image[0] = 0xFF;
+        night.Display(image.Raw(), at_three + std::chrono::minutes(30));
+        REQUIRE(panel->counters().full_refreshes == 3);
+        REQUIRE(panel->counters().partial_refreshes == 1);
+    }
+}
+
+TEST_CASE("epaper counts where the time goes", "[epaper][simulated]") {
+    SimulatedPanel::Timing timing = kNoDelay;
+    timing.full_refresh_msec      = 50;
+
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, timing);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+    REQUIRE(paper.stats().wait_time >= std::chrono::milliseconds(200));
+
+    paper.ResetStats();
+    panel->ResetCounters();
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    image.ClearBlack();
+    paper.DisplayImage(image.Raw());
+
+    const Epaper::Stats& stats = paper.stats();
+    REQUIRE(stats.full_refreshes == 1);
+    REQUIRE(stats.partial_refreshes == 0);
+    REQUIRE(stats.command_bytes[0x24] == Epaper::kFrameSize);
+    REQUIRE(stats.data_bytes == panel->counters().data_bytes);
+    REQUIRE(stats.commands == panel->counters().commands);
+    REQUIRE(stats.gpio_writes == panel->counters().pin_writes);
+    REQUIRE(panel->counters().pin_toggles == panel->counters().pin_writes);  // no redundant dc
+    REQUIRE(stats.busy_time >= std::chrono::milliseconds(timing.full_refresh_msec));
+
+    std::wostringstream dump;
+    paper.DumpStats(dump);
+    REQUIRE(dump.str().find(L"refreshes: 1 full, 0 partial") != std::wstring::npos);
+}
+
+TEST_CASE("recorded command stream replays onto another panel", "[epaper][simulated]") {
+    // a fresh file under the temp dir so parallel runs and the source tree stay untouched
+    const char* tmpdir   = std::getenv("TMPDIR");
+    std::string path     = std::string(tmpdir ? tmpdir : "/tmp") + "/epaper_trace_XXXXXX";
+    int         trace_fd = mkstemp(&path[0]);
+    REQUIRE(trace_fd >= 0);
+    close(trace_fd);
+
+    auto recorded = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    auto image    = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    for (uint16_t i = 0; i < Epaper::kFrameSize; i++) {
+        image[i] = (i * 7) & 0xFF;
+    }
+
+    {
+        auto   recorder = std::make_shared<TraceRecorder>(recorded, recorded, path);
+        Epaper paper(recorder, recorder);
+        paper.SetUpIos();
+        paper.InitFullUpdate();
+        paper.DisplayImage(image.Raw());
+
+        // written out as it goes rather than only when the recorder goes away
+        std::ifstream partial(path, std::ios::binary | std::ios::ate);
+        REQUIRE(static_cast<size_t>(partial.tellg()) > Epaper::kFrameSize);
+
+        paper.DeepSleep();
+    }
+
+    auto replayed = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, kNoDelay);
+    TraceReplayer replayer(replayed, replayed);
+    REQUIRE(replayer.Replay(path));
+
+    REQUIRE(replayed->Displayed() == to_vector(image));
+    REQUIRE(replayed->counters().commands == recorded->counters().commands);
+    REQUIRE(replayed->counters().data_bytes == recorded->counters().data_bytes);
+    REQUIRE(replayed->counters().full_refreshes == 1);
+    REQUIRE(replayed->sleeping());
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("busy waits learn how long the panel takes", "[epaper][simulated]") {
+    SimulatedPanel::Timing timing = kNoDelay;
+    timing.partial_refresh_msec   = 60;
+
+    auto   panel = std::make_shared<SimulatedPanel>(Epaper::kHeight, Epaper::kWidth, timing);
+    Epaper paper(panel, panel);
+    paper.SetUpIos();
+    paper.InitFullUpdate();
+
+    auto image = Bitmap(Epaper::kHeight, Epaper::kWidth);
+    paper.DisplayBaseImage(image.Raw());
+    paper.InitPartialUpdate();
+
+    // the first waits are left to the backend, later ones sleep until the predicted end
+    for (uint16_t n = 0; n < 4; n++) {
+        image[n] = 0x00;
+        paper.DisplayPartial(image.Raw());
+    }
+    REQUIRE(panel->counters().partial_refreshes == 4);
+
+    paper.ResetStats();
+    image[10] = 0x00;
+    paper.DisplayPartial(image.Raw());
+
+    REQUIRE(paper.stats().partial_refreshes == 1);
+    REQUIRE(paper.stats().busy_time >= std::chrono::milliseconds(timing.partial_refresh_msec));
+    REQUIRE(paper.stats().busy_time < std::chrono::milliseconds(timing.partial_refresh_msec + 30));
+    REQUIRE(paper.stats().busy_polls < 15);
+    REQUIRE(panel->Displayed() == to_vector(image));
+
+    SECTION("a wait that is already over returns at once") {
+        auto start = std::chrono::steady_clock::now();
+        paper.BusyWait(Epaper::BusyPartial);
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10));
+    }
+}